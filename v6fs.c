@@ -0,0 +1,2311 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include "v6fs_internal.h"
+
+//writing a message to the log of the handle if level is enabled, hot paths check the level first with V6FS_DEBUG()
+void v6fsLog(v6fs_t* fs,int level,const char* format,...){
+    if(level > fs->log_level || fs->log_out == NULL)
+        return;
+    va_list args;
+    va_start(args,format);
+    vfprintf(fs->log_out,format,args);
+    va_end(args);
+    fputc('\n',fs->log_out);
+}
+
+/*
+Block cache
+every access to the file system image goes through these functions. A block is read from the image only on a miss,
+modified in memory and written back when it is evicted or when syncFS() is called
+*/
+
+//unlinking a cache entry from the LRU list
+void lruUnlink(v6fs_t* fs,cache_entry_type* entry){
+    if(entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        fs->lru_head = entry->lru_next;
+
+    if(entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        fs->lru_tail = entry->lru_prev;
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+//placing a cache entry at the most recently used end of the LRU list
+void lruPushFront(v6fs_t* fs,cache_entry_type* entry){
+    entry->lru_prev = NULL;
+    entry->lru_next = fs->lru_head;
+    if(fs->lru_head != NULL)
+        fs->lru_head->lru_prev = entry;
+    fs->lru_head = entry;
+    if(fs->lru_tail == NULL)
+        fs->lru_tail = entry;
+}
+
+cache_entry_type* cacheLookup(v6fs_t* fs,int bNumber){
+    cache_entry_type* entry = fs->cache_hash[bNumber & (fs->cache_hash_size-1)];
+    while(entry != NULL && entry->bNumber != bNumber)
+        entry = entry->hash_next;
+    return entry;
+}
+
+void cacheHashRemove(v6fs_t* fs,cache_entry_type* entry){
+    cache_entry_type** link = &fs->cache_hash[entry->bNumber & (fs->cache_hash_size-1)];
+    while(*link != entry)
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+    entry->hash_next = NULL;
+}
+
+void cacheWriteBack(v6fs_t* fs,cache_entry_type* entry){
+    pwrite(fs->fd,entry->data,BLOCKSIZE,(off_t)BLOCKSIZE * entry->bNumber);
+    V6FS_STAT(fs,writes,1);
+    V6FS_STAT(fs,write_bytes,BLOCKSIZE);
+    if(entry->dirty)
+        fs->cache_dirty--;
+    entry->dirty = 0;
+}
+
+//allocating the hash table, sized to a power of two at least twice the capacity to keep chains short
+void cacheInit(v6fs_t* fs){
+    fs->cache_hash_size = 1;
+    while(fs->cache_hash_size < 2*fs->cache_capacity)
+        fs->cache_hash_size = fs->cache_hash_size << 1;
+    fs->cache_hash = calloc(fs->cache_hash_size,sizeof(cache_entry_type*));
+    fs->cache_count = 0;
+    fs->cache_dirty = 0;
+    fs->lru_head = NULL;
+    fs->lru_tail = NULL;
+}
+
+/*
+cacheGet() - returns the cache entry for bNumber, loading it from the image on a miss
+parameters: bNumber - block number, doRead - 0 when the caller overwrites the whole block so reading it is not needed
+description: on a miss the least recently used entry is reused once the cache is full, writing it back first if it is dirty.
+            With a journal the least recently used clean entry is, and a new one is added when all of them are dirty
+*/
+cache_entry_type* cacheGet(v6fs_t* fs,int bNumber,int doRead){
+    if(fs->cache_hash == NULL)
+        cacheInit(fs);
+
+    cache_entry_type* entry = cacheLookup(fs,bNumber);
+
+    if(entry != NULL){
+        V6FS_STAT(fs,cache_hits,1);
+        lruUnlink(fs,entry);
+        lruPushFront(fs,entry);
+        if(doRead == 0)
+            memset(entry->data,0,BLOCKSIZE);
+        return entry;
+    }
+
+    //with a journal a dirty block may only go home through a commit, which never happens in the middle of a call
+    entry = fs->cache_count < fs->cache_capacity ? NULL : fs->lru_tail;
+    if(journaling(fs)){
+        while(entry != NULL && entry->dirty)
+            entry = entry->lru_prev;
+    }
+
+    if(entry == NULL){
+        entry = malloc(sizeof(cache_entry_type));
+        fs->cache_count++;
+    }else{
+        lruUnlink(fs,entry);
+        cacheHashRemove(fs,entry);
+        if(entry->dirty)
+            cacheWriteBack(fs,entry);
+    }
+
+    entry->bNumber = bNumber;
+    entry->dirty = 0;
+    V6FS_STAT(fs,cache_misses,1);
+
+    if(doRead){
+        //reading past the end of the image (a block that was never written) yields zeros
+        int num_bytes = pread(fs->fd,entry->data,BLOCKSIZE,(off_t)BLOCKSIZE * bNumber);
+        V6FS_STAT(fs,reads,1);
+        V6FS_STAT(fs,read_bytes,num_bytes > 0 ? num_bytes : 0);
+        if(num_bytes < 0)
+            num_bytes = 0;
+        if(num_bytes < BLOCKSIZE)
+            memset(entry->data + num_bytes,0,BLOCKSIZE - num_bytes);
+    }else{
+        memset(entry->data,0,BLOCKSIZE);
+    }
+
+    entry->hash_next = fs->cache_hash[bNumber & (fs->cache_hash_size-1)];
+    fs->cache_hash[bNumber & (fs->cache_hash_size-1)] = entry;
+    lruPushFront(fs,entry);
+
+    return entry;
+}
+
+//checking if bNumber lies inside the mapped image
+int blockIsMapped(v6fs_t* fs,int bNumber){
+    return fs->image_map != NULL && (size_t)BLOCKSIZE * (bNumber+1) <= fs->image_map_size;
+}
+
+//returns a pointer to the cached contents of bNumber, valid until the next cache access that may evict it
+//in mmap mode the pointer is into the mapping and stays valid until the image is closed
+char* getBlock(v6fs_t* fs,int bNumber){
+    if(blockIsMapped(fs,bNumber))
+        return fs->image_map + (size_t)BLOCKSIZE * bNumber;
+    return cacheGet(fs,bNumber,1)->data;
+}
+
+//returns a zero filled cached block without reading it from the image, for blocks which will be fully overwritten
+char* getEmptyBlock(v6fs_t* fs,int bNumber){
+    if(blockIsMapped(fs,bNumber)){
+        char* block = fs->image_map + (size_t)BLOCKSIZE * bNumber;
+        memset(block,0,BLOCKSIZE);
+        return block;
+    }
+    return cacheGet(fs,bNumber,0)->data;
+}
+
+//writing bNumber to the image now if it is dirty, without waiting for eviction or syncFS(fs)
+void flushBlock(v6fs_t* fs,int bNumber){
+    if(blockIsMapped(fs,bNumber) || fs->cache_hash == NULL)
+        return;
+    cache_entry_type* entry = cacheLookup(fs,bNumber);
+    if(entry != NULL && entry->dirty)
+        cacheWriteBack(fs,entry);
+}
+
+//dropping bNumber from the cache without writing it back, used before the block is written to the image directly
+void cacheDiscard(v6fs_t* fs,int bNumber){
+    if(blockIsMapped(fs,bNumber) || fs->cache_hash == NULL)
+        return;
+    cache_entry_type* entry = cacheLookup(fs,bNumber);
+    if(entry == NULL)
+        return;
+    lruUnlink(fs,entry);
+    cacheHashRemove(fs,entry);
+    if(entry->dirty)
+        fs->cache_dirty--;
+    free(entry);
+    fs->cache_count--;
+}
+
+//evicting clean blocks until the cache is back to its size, the dirty ones it grew by are clean after a commit
+void cacheTrim(v6fs_t* fs){
+    cache_entry_type* entry = fs->lru_tail;
+    while(fs->cache_count > fs->cache_capacity && entry != NULL){
+        cache_entry_type* prev = entry->lru_prev;
+        if(entry->dirty == 0)
+            cacheDiscard(fs,entry->bNumber);
+        entry = prev;
+    }
+}
+
+void markBlockDirty(v6fs_t* fs,int bNumber){
+    if(blockIsMapped(fs,bNumber))
+        return; //stores into the mapping are written back by the kernel and msync
+    if(fs->cache_hash == NULL)
+        return;
+    cache_entry_type* entry = cacheLookup(fs,bNumber);
+    if(entry != NULL && entry->dirty == 0){
+        entry->dirty = 1;
+        fs->cache_dirty++;
+    }
+}
+
+int compareCacheEntries(const void* a,const void* b){
+    return (*(cache_entry_type**)a)->bNumber - (*(cache_entry_type**)b)->bNumber;
+}
+
+//writing all dirty inodes and blocks back to the image in increasing block order
+void syncFS(v6fs_t* fs){
+    icacheFlush(fs);
+    reclaimDrain(fs);
+    releaseDeferred(fs); //the chain written for the commit below includes them
+    if(journaling(fs)){
+        //a rewrite of the free chain goes out on its own when it doesn't fit with the rest
+        if(fs->extent_alloc && fs->free_chain_dirty)
+            journalReserve(fs,freeChainBlocks(fs));
+        syncFreeChain(fs);
+        journalCommit(fs);
+        while(fs->num_deferred > 0 && journalCommit(fs) == V6FS_OK)
+            ; //freed blocks left over by a transaction without room for all of them
+        punchFlush(fs); //blocks are only scrubbed once the transaction freeing them is committed
+        return;
+    }
+    syncFreeChain(fs);
+    flushSuperBlock(fs);
+    punchFlush(fs);
+
+    if(fs->image_map != NULL){
+        msync(fs->image_map,fs->image_map_size,MS_SYNC);
+        V6FS_STAT(fs,syncs,1);
+    }
+
+    if(fs->cache_hash == NULL)
+        return;
+
+    cache_entry_type** dirty = malloc(sizeof(cache_entry_type*) * (fs->cache_count+1));
+    int num_dirty = 0;
+    cache_entry_type* entry;
+
+    for(entry = fs->lru_head;entry != NULL;entry = entry->lru_next){
+        if(entry->dirty)
+            dirty[num_dirty++] = entry;
+    }
+
+    qsort(dirty,num_dirty,sizeof(cache_entry_type*),compareCacheEntries);
+
+    int i;
+    for(i=0;i<num_dirty;i++)
+        cacheWriteBack(fs,dirty[i]);
+
+    free(dirty);
+}
+
+//flushing and releasing every cached inode and block, used when the image or the cache size changes
+void cacheDestroy(v6fs_t* fs){
+    icacheDestroy(fs);
+    if(fs->cache_hash == NULL)
+        return;
+
+    syncFS(fs);
+
+    while(fs->lru_head != NULL){
+        cache_entry_type* entry = fs->lru_head;
+        fs->lru_head = entry->lru_next;
+        free(entry);
+    }
+    free(fs->cache_hash);
+    fs->cache_hash = NULL;
+    fs->lru_tail = NULL;
+    fs->cache_count = 0;
+    fs->cache_dirty = 0;
+}
+
+/*
+mapImage() - maps the whole image of num_blocks blocks, growing the file to that size first
+description: the file is extended with ftruncate so the unwritten part is sparse and reads as zeros.
+            any block still held in the block cache is flushed first so the mapping sees it
+*/
+int mapImage(v6fs_t* fs,int num_blocks){
+    cacheDestroy(fs);
+
+    if(fs->image_map != NULL){
+        munmap(fs->image_map,fs->image_map_size);
+        fs->image_map = NULL;
+    }
+
+    size_t map_size = (size_t)BLOCKSIZE * num_blocks;
+    struct stat st;
+    fstat(fs->fd,&st);
+    if((size_t)st.st_size < map_size)
+        ftruncate(fs->fd,map_size);
+
+    void* map = mmap(NULL,map_size,PROT_READ | PROT_WRITE,MAP_SHARED,fs->fd,0);
+    if(map == MAP_FAILED){
+        v6fsLog(fs,V6FS_LOG_INFO,"mmap of the file system failed, falling back to the block cache");
+        return V6FS_EIO; //blocks keep going through the block cache
+    }
+
+    fs->image_map = map;
+    fs->image_map_size = map_size;
+    V6FS_DEBUG(fs,"File system mapped, %d blocks",num_blocks);
+    return 1;
+}
+
+void unmapImage(v6fs_t* fs){
+    if(fs->image_map == NULL)
+        return;
+    msync(fs->image_map,fs->image_map_size,MS_SYNC);
+    munmap(fs->image_map,fs->image_map_size);
+    fs->image_map = NULL;
+    fs->image_map_size = 0;
+}
+
+void setCacheSize(v6fs_t* fs,int num_blocks){
+    if(num_blocks < 8)
+        num_blocks = 8; //a single operation touches a few blocks at once, they must not evict each other
+    cacheDestroy(fs);
+    fs->cache_capacity = num_blocks;
+}
+
+//This method will write a block to FileSystem
+void writeBlockToFS(v6fs_t* fs,int bNumber,void *input, int num_bytes){
+    //a whole block written over needn't be read from the image first
+    char* block = num_bytes == BLOCKSIZE ? getEmptyBlock(fs,bNumber) : getBlock(fs,bNumber);
+    memcpy(block,input,num_bytes);
+    markBlockDirty(fs,bNumber);
+}
+
+/*
+flushSuperBlock() - writes the in-memory superblock to the image if it was modified
+description: block allocation and freeing only change fs->superBlock in memory and set fmod.
+            The superblock is written here at the sync points instead of on every change
+*/
+void flushSuperBlock(v6fs_t* fs){
+    if(fs->superBlock.fmod == 0)
+        return;
+
+    //in extent mode the free list in the superblock is only valid once syncFreeChain(fs) has rebuilt it
+    if(fs->free_chain_dirty)
+        return;
+
+    fs->superBlock.fmod = 0;
+    fs->superBlock.time = (int)time(NULL);
+    writeBlockToFS(fs,1,&fs->superBlock,sizeof(fs->superBlock));
+    if(journaling(fs) == 0)
+        flushBlock(fs,1); //with a journal block 1 goes out with the next commit like every other metadata block
+}
+
+/*
+buildInodeBitmap() - scans the inode table once and records which inodes are allocated
+description: bits past the last inode are set so they are never handed out. Afterwards allocating and
+            freeing an inode only touch the bitmap, the inode table is not scanned again. The table blocks are read
+            directly, the inode cache is empty when an image is opened or formatted
+*/
+void buildInodeBitmap(v6fs_t* fs){
+    int total_num_inodes = fs->superBlock.isize*16;
+
+    free(fs->inode_bitmap);
+    fs->inode_bitmap_words = (total_num_inodes+63)/64;
+    fs->inode_bitmap = calloc(fs->inode_bitmap_words,sizeof(unsigned long long));
+    fs->inode_hint_word = 0;
+    fs->num_free_inodes = 0;
+
+    V6FS_STAT(fs,inodes_scanned,total_num_inodes);
+    int i;
+    for(i=1;i<=fs->inode_bitmap_words*64;i++){
+        if(i > total_num_inodes || (((inode_type*)(getBlock(fs,2 + (i-1)/16) + ((i-1)%16)*INODESIZE))->flags & 1<<15))
+            fs->inode_bitmap[(i-1)/64] |= 1ULL << ((i-1)%64);
+        else
+            fs->num_free_inodes++;
+    }
+}
+
+//marking inode iNumber as allocated, used when a specific inode such as the root is claimed
+void markInodeAllocated(v6fs_t* fs,int iNumber){
+    unsigned long long bit = 1ULL << ((iNumber-1)%64);
+    if((fs->inode_bitmap[(iNumber-1)/64] & bit) == 0){
+        fs->inode_bitmap[(iNumber-1)/64] |= bit;
+        fs->num_free_inodes--;
+        V6FS_STAT(fs,inodes_allocated,1);
+    }
+}
+
+//returning inode iNumber to the free pool
+void releaseInode(v6fs_t* fs,int iNumber){
+    unsigned long long bit = 1ULL << ((iNumber-1)%64);
+    if(fs->inode_bitmap[(iNumber-1)/64] & bit){
+        fs->inode_bitmap[(iNumber-1)/64] &= ~bit;
+        fs->num_free_inodes++;
+        V6FS_STAT(fs,inodes_freed,1);
+        if((iNumber-1)/64 < fs->inode_hint_word)
+            fs->inode_hint_word = (iNumber-1)/64;
+    }
+}
+
+//taking the lowest numbered free inode from the bitmap, starting at the hint word so full words are never rescanned
+int findUnallocatedInode(v6fs_t* fs){
+    if(fs->num_free_inodes == 0)
+        return V6FS_ENOINODE;
+
+    int first_word = fs->inode_hint_word;
+    while(fs->inode_bitmap[fs->inode_hint_word] == ~0ULL)
+        fs->inode_hint_word++;
+    V6FS_STAT(fs,inodes_scanned,64*(fs->inode_hint_word - first_word + 1));
+
+    int i = fs->inode_hint_word*64 + __builtin_ctzll(~fs->inode_bitmap[fs->inode_hint_word]) + 1;
+    markInodeAllocated(fs,i);
+    V6FS_DEBUG(fs,"%d allocated as free inode",i);
+    return i;
+}
+
+/*
+Dentry cache
+maps (parent directory inode, name) to the inode found in that directory and the byte address of its directory entry.
+Negative entries (inode -1) remember names which are not present so failed lookups don't rescan the directory either.
+Entries are dropped by makedir, cpin and rm when they change a directory and all of them on openfs/initfs
+*/
+
+//mixing the parent inode with the name for the bucket index
+unsigned int dentryHash(int parent,char* name){
+    unsigned int hash = 2166136261u ^ parent;
+    int i;
+    for(i=0;i<28 && name[i]!='\0';i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    return hash & (DENTRY_BUCKETS-1);
+}
+
+dentry_type* dentryFind(v6fs_t* fs,int parent,char* name){
+    dentry_type* entry = fs->dentry_hash[dentryHash(parent,name)];
+    while(entry != NULL && (entry->parent != parent || strncmp(entry->name,name,28) != 0))
+        entry = entry->next;
+    return entry;
+}
+
+/*
+dentryLookup() - checks the dentry cache for name in directory parent
+returns the child inode on a positive hit (also setting fs->addr_dir and fs->addr_inode like path_to_inode does),
+-1 for a cached negative entry and 0 when nothing is cached
+*/
+int dentryLookup(v6fs_t* fs,int parent,char* name){
+    dentry_type* entry = dentryFind(fs,parent,name);
+    if(entry == NULL)
+        return 0;
+    if(entry->inode == -1)
+        return -1;
+    fs->addr_dir = entry->addr;
+    fs->addr_inode = parent;
+    return entry->inode;
+}
+
+//dropping every cached entry
+void dentryClear(v6fs_t* fs){
+    int i;
+    for(i=0;i<DENTRY_BUCKETS;i++){
+        while(fs->dentry_hash[i] != NULL){
+            dentry_type* entry = fs->dentry_hash[i];
+            fs->dentry_hash[i] = entry->next;
+            free(entry);
+        }
+    }
+    fs->dentry_count = 0;
+}
+
+//caching the result of a directory scan, inode -1 records that name is absent from parent
+void dentryInsert(v6fs_t* fs,int parent,char* name,int inode,long long addr){
+    dentry_type* entry = dentryFind(fs,parent,name);
+
+    if(entry == NULL){
+        if(fs->dentry_count >= DENTRY_CAPACITY)
+            dentryClear(fs); //starting over is cheaper than tracking recency for a cache this size
+        entry = malloc(sizeof(dentry_type));
+        entry->parent = parent;
+        strncpy(entry->name,name,28);
+        entry->name[28] = '\0';
+        unsigned int bucket = dentryHash(parent,name);
+        entry->next = fs->dentry_hash[bucket];
+        fs->dentry_hash[bucket] = entry;
+        fs->dentry_count++;
+    }
+
+    entry->inode = inode;
+    entry->addr = addr;
+}
+
+void dentryInvalidate(v6fs_t* fs,int parent,char* name){
+    dentry_type** link = &fs->dentry_hash[dentryHash(parent,name)];
+    while(*link != NULL){
+        dentry_type* entry = *link;
+        if(entry->parent == parent && strncmp(entry->name,name,28) == 0){
+            *link = entry->next;
+            free(entry);
+            fs->dentry_count--;
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+//dropping all entries looked up inside directory parent, used when that directory itself is removed
+void dentryInvalidateParent(v6fs_t* fs,int parent){
+    int i;
+    for(i=0;i<DENTRY_BUCKETS;i++){
+        dentry_type** link = &fs->dentry_hash[i];
+        while(*link != NULL){
+            dentry_type* entry = *link;
+            if(entry->parent == parent || entry->inode == parent){
+                *link = entry->next;
+                free(entry);
+                fs->dentry_count--;
+            }else{
+                link = &entry->next;
+            }
+        }
+    }
+}
+
+//utiliity function to allocate a free block to a directory
+int allocateFreeBlockToDir(v6fs_t* fs,int blockNumber, int parentInode,int firstBlock,int free_inode){
+    int newDataBlock;
+
+    //either get a free block or use the parameter passed
+    if(blockNumber == -1)
+        newDataBlock = getFreeBlock(fs);
+    else
+        newDataBlock = blockNumber;
+
+    if(newDataBlock < 0)
+        return newDataBlock;
+
+    int i = 0;
+    dir_type* directory = (dir_type*)getEmptyBlock(fs,newDataBlock);
+
+    //allocating . and .. only for addr[0]
+    if(firstBlock == 1){
+        directory[0].inode = free_inode;
+        directory[1].inode = parentInode;
+
+        directory[0].filename[0] = '.';
+
+        directory[1].filename[0] = '.';
+        directory[1].filename[1] = '.';
+
+        i = 2;
+    }
+
+    //writing default directory entries for all 32 bytes in a block dedicated for directory
+    for(;i<32;i++){
+        directory[i].inode = -1;
+        memset(directory[i].filename,'\0',sizeof(directory[i].filename));
+    }
+
+    markBlockDirty(fs,newDataBlock);
+
+    return newDataBlock; //return the block number to attach it to addr of parent inode
+}
+
+//allocating a new inode to directory
+int allocateNewInodeToDir(v6fs_t* fs,int inode_num, int parentInode){
+    int free_inode;
+
+    if(inode_num == -1)
+        free_inode = findUnallocatedInode(fs);
+    else{
+        free_inode = inode_num;
+        markInodeAllocated(fs,free_inode);
+    }
+
+    if(free_inode < 0)
+        return free_inode;
+
+    //read the free inode to change values
+    inode_type newInode;
+    readInodeFromFS(fs,free_inode,&newInode);
+
+    //since its a new inode dedicated to directory only one data block is sufficient
+    int newDataBlock = allocateFreeBlockToDir(fs,-1,parentInode,1,free_inode);
+
+    if(newDataBlock < 0){
+        releaseInode(fs,free_inode);
+        return newDataBlock;
+    }
+
+    //writing all the default values of inode
+
+    //flags - 1(allocated)10(directory)00(small file)1(uid)1(gid)111(rwx for owner)101(rx for group)100(read for everyone)
+    newInode.flags = fs->root_inode.flags | 51180;
+    newInode.size0 = 0;
+    newInode.size1 = 2*32; //size of two directories i.e. . and ..
+    newInode.nlinks = 1;
+    newInode.uid = 0;
+    newInode.gid = 0;
+    newInode.addr[0] = newDataBlock; //assigning the new data block to addr[0]
+    newInode.actime = (int)time(NULL);
+    newInode.modtime = (int)time(NULL); //unix epoch time
+
+    //writing inode to the filesystem
+    writeInodeToFS(fs,free_inode,&newInode,sizeof(newInode));
+
+    return free_inode;
+}
+
+/*
+Extent allocator
+the free chain is a LIFO stack, so after some rm/cpin cycles consecutive allocations are scattered over the image.
+In extent mode (allocmode extent) the free blocks are tracked in fs->block_bitmap instead, rebuilt from the free chain
+at openfs, and files get the longest contiguous runs available. The free chain is rewritten from the bitmap at
+sync points in the usual on-disk format, so the image stays readable in the default mode
+*/
+
+void allocBlockBitmap(v6fs_t* fs,int totalBlocks){
+    free(fs->block_bitmap);
+    fs->block_bitmap_words = (totalBlocks+63)/64;
+    fs->block_bitmap = calloc(fs->block_bitmap_words,sizeof(unsigned long long));
+    fs->alloc_cursor = 0;
+    fs->res_next = 0;
+    fs->res_end = 0;
+    fs->res_want = 0;
+}
+
+//returns the first bit at or after bit whose value is value (0 or 1), or num_words*64 when there is none
+int nextBit(unsigned long long* bits,int num_words,int bit,int value){
+    int word = bit/64;
+    if(word >= num_words)
+        return num_words*64;
+
+    unsigned long long flip = value ? 0 : ~0ULL;
+    unsigned long long found = (bits[word] ^ flip) & (~0ULL << (bit%64));
+    while(found == 0){
+        word++;
+        if(word >= num_words)
+            return num_words*64;
+        found = bits[word] ^ flip;
+    }
+    return word*64 + __builtin_ctzll(found);
+}
+
+//returns the first free block at or after bNumber, or -1
+int nextFreeBlock(v6fs_t* fs,int bNumber){
+    int next = nextBit(fs->block_bitmap,fs->block_bitmap_words,bNumber,1);
+    return next == fs->block_bitmap_words*64 ? -1 : next;
+}
+
+//returns the first allocated block at or after bNumber, which ends the free run containing bNumber
+int nextUsedBlock(v6fs_t* fs,int bNumber){
+    return nextBit(fs->block_bitmap,fs->block_bitmap_words,bNumber,0);
+}
+
+//walking the free chain and setting the bit of every block on it, including the chain blocks themselves
+void buildBlockBitmap(v6fs_t* fs){
+    allocBlockBitmap(fs,fs->superBlock.fsize);
+
+    unsigned int chain[252];
+    int nfree = fs->superBlock.nfree;
+    memcpy(chain + 1,fs->superBlock.free,sizeof(fs->superBlock.free));
+
+    while(nfree > 0){
+        int k;
+        for(k=1;k<nfree;k++)
+            fs->block_bitmap[chain[k+1]/64] |= 1ULL << (chain[k+1]%64);
+
+        int chainBlock = chain[1];
+        if(chainBlock == 0)
+            break;
+        fs->block_bitmap[chainBlock/64] |= 1ULL << (chainBlock%64);
+        memcpy(chain,getBlock(fs,chainBlock),sizeof(chain));
+        nfree = chain[0];
+    }
+    fs->free_chain_dirty = 0;
+}
+
+/*
+writeFreeChain() - writes the free blocks in fs->block_bitmap as a free chain starting in the superblock
+description: produces the format addFreeBlock(fs) builds (fs->superBlock.free[0] and chain[1] point to the next chain block,
+            0 ends the chain). Each list holds a run of up to 250 blocks in descending order with the chain block
+            right after them, so getFreeBlock(fs) hands out blocks in ascending order. Only the chain blocks are written
+*/
+void writeFreeChain(v6fs_t* fs){
+    unsigned int chain[256];
+    unsigned int* list = fs->superBlock.free;
+    unsigned int* count = &fs->superBlock.nfree;
+    int chainBlock = -1;
+    int bNumber = nextFreeBlock(fs,0);
+
+    while(1){
+        unsigned int group[251];
+        int num = 0;
+        while(num < 251 && bNumber != -1){
+            group[num++] = bNumber;
+            bNumber = nextFreeBlock(fs,bNumber+1);
+        }
+
+        int k;
+        if(num <= 250){
+            list[0] = 0; //end of the chain
+            for(k=1;k<=num;k++)
+                list[k] = group[num-k];
+            *count = num + 1;
+        }else{
+            list[0] = group[250]; //the block after this run holds the next list
+            for(k=1;k<=250;k++)
+                list[k] = group[250-k];
+            *count = 251;
+        }
+
+        if(chainBlock != -1)
+            punchCancel(fs,chainBlock); //a block freed since the last sync point may end up holding the chain
+        if(chainBlock != -1 && journaling(fs)){
+            memcpy(getEmptyBlock(fs,chainBlock),chain,BLOCKSIZE);
+            markBlockDirty(fs,chainBlock);
+        }else if(chainBlock != -1){
+            cacheDiscard(fs,chainBlock);
+            pwrite(fs->fd,chain,BLOCKSIZE,(off_t)BLOCKSIZE * chainBlock);
+            V6FS_STAT(fs,writes,1);
+            V6FS_STAT(fs,write_bytes,BLOCKSIZE);
+        }
+
+        if(num <= 250)
+            break;
+
+        chainBlock = group[250];
+        memset(chain,0,sizeof(chain));
+        count = &chain[0];
+        list = &chain[1];
+    }
+
+    fs->superBlock.fmod = 1;
+    fs->free_chain_dirty = 0;
+}
+
+//number of blocks writeFreeChain(fs) writes for the free blocks in fs->block_bitmap
+int freeChainBlocks(v6fs_t* fs){
+    long long num_free = 0;
+    int w;
+    for(w=0;w<fs->block_bitmap_words;w++)
+        num_free += __builtin_popcountll(fs->block_bitmap[w]);
+    return num_free/251 + 1;
+}
+
+//rewriting the free chain if extent allocations or frees changed it
+void syncFreeChain(v6fs_t* fs){
+    if(fs->extent_alloc && fs->free_chain_dirty)
+        writeFreeChain(fs);
+}
+
+/*
+allocateExtent() - takes a run of free blocks out of fs->block_bitmap
+parameters: num_blocks - blocks wanted, start - set to the first block of the run
+description: returns the length of the first run of at least num_blocks free blocks after the cursor (cut to num_blocks),
+            or of the longest run in the image when none is long enough. Returns 0 when no block is free
+*/
+int allocateExtent(v6fs_t* fs,int num_blocks,int* start){
+    int best_start = -1;
+    int best_len = 0;
+    int pass;
+
+    for(pass=0;pass<2 && best_len < num_blocks;pass++){
+        int bNumber = nextFreeBlock(fs,pass == 0 ? fs->alloc_cursor : 0);
+        int limit = pass == 0 ? fs->block_bitmap_words*64 : fs->alloc_cursor;
+
+        while(bNumber != -1 && bNumber < limit){
+            int end = nextUsedBlock(fs,bNumber);
+            if(end - bNumber > best_len){
+                best_start = bNumber;
+                best_len = end - bNumber;
+                if(best_len >= num_blocks)
+                    break;
+            }
+            bNumber = nextFreeBlock(fs,end);
+        }
+    }
+
+    if(best_len == 0)
+        return 0;
+    if(best_len > num_blocks)
+        best_len = num_blocks;
+
+    int b;
+    for(b=best_start;b<best_start+best_len;b++)
+        fs->block_bitmap[b/64] &= ~(1ULL << (b%64));
+
+    *start = best_start;
+    fs->alloc_cursor = best_start + best_len;
+    fs->free_chain_dirty = 1;
+    return best_len;
+}
+
+//reserving num_blocks blocks for the file about to be written so they come from as few runs as possible
+void reserveBlocks(v6fs_t* fs,int num_blocks){
+    if(fs->extent_alloc)
+        fs->res_want = num_blocks;
+}
+
+//returning reserved blocks that were not used
+void releaseReservation(v6fs_t* fs){
+    if(fs->extent_alloc == 0)
+        return;
+    int b;
+    for(b=fs->res_next;b<fs->res_end;b++)
+        fs->block_bitmap[b/64] |= 1ULL << (b%64);
+    fs->res_next = 0;
+    fs->res_end = 0;
+    fs->res_want = 0;
+}
+
+//getFreeBlock(fs) in extent mode, serving the current reservation first
+int getExtentBlock(v6fs_t* fs){
+    if(fs->res_next == fs->res_end){
+        int start;
+        int len = allocateExtent(fs,fs->res_want > 0 ? fs->res_want : 1,&start);
+        if(len == 0)
+            return V6FS_ENOSPC;
+        fs->res_next = start;
+        fs->res_end = start + len;
+        fs->res_want = fs->res_want > len ? fs->res_want - len : 0;
+    }
+    return fs->res_next++;
+}
+
+//switching between the free chain and the extent allocator, the chain is written out before leaving extent mode
+void setAllocMode(v6fs_t* fs,int mode){
+    if(mode == V6FS_ALLOC_EXTENT){
+        if(fs->extent_alloc == 0){
+            fs->extent_alloc = 1;
+            if(fs->superBlock.fsize > 0)
+                buildBlockBitmap(fs);
+        }
+    }else if(fs->extent_alloc){
+        if(fs->free_chain_dirty)
+            journalReserve(fs,freeChainBlocks(fs));
+        syncFreeChain(fs);
+        fs->extent_alloc = 0;
+        free(fs->block_bitmap);
+        fs->block_bitmap = NULL;
+        journalCommit(fs); //list mode hands out the blocks of the new chain, the committed superblock has to lead to it
+    }
+}
+
+/*
+openImage() - opens the file system image behind a new handle
+parameters: fileName - image path, flags - V6FS_MMAP to access the image through a shared mapping
+description: an image which already holds a superblock and root inode is loaded, otherwise it has to be formatted
+*/
+int openImage(v6fs_t* fs,const char* fileName,int flags){
+
+    fs->mmap_mode = (flags & V6FS_MMAP) != 0;
+
+    //Opening a file with read write persmission and creating in case it is absent
+    fs->fd = open(fileName, O_CREAT | O_RDWR, 0644);
+    if(fs->fd == -1)
+        return V6FS_EIO;
+
+    //changes committed to the journal before a crash are written home before anything is read
+    if(journalOpen(fs) < 0)
+        return V6FS_EIO;
+
+    //Checking if the file is already present with super block and inode written
+    struct stat st;
+    fstat(fs->fd, &st);
+    if(st.st_size >= (2*BLOCKSIZE+INODESIZE)){
+        memcpy(&fs->superBlock,getBlock(fs,1),sizeof(fs->superBlock));
+        fs->superBlock.fmod = 0; //in memory copy matches the image
+        if(fs->mmap_mode)
+            mapImage(fs,fs->superBlock.fsize);
+        readInodeFromFS(fs,1,&fs->root_inode);
+        buildInodeBitmap(fs);
+        if(fs->extent_alloc)
+            buildBlockBitmap(fs);
+        fs->curr_inode = 1;
+    }
+    return V6FS_OK;
+}
+
+//Adding a free block by writing to the filesystem
+//modified to handle case when random block is freed at a random and free array is full
+//the contents of a freed block are left to scrubBlock(fs), only a block receiving the free array is written
+void putFreeBlock(v6fs_t* fs,int bNumber){
+    V6FS_DEBUG(fs,"Block number %d freed",bNumber);
+    if(bNumber > 0)
+        V6FS_STAT(fs,blocks_freed,1);
+
+    //in extent mode the block goes back into the bitmap and the chain is rewritten at the next sync
+    if(fs->extent_alloc){
+        if(bNumber > 0){
+            scrubBlock(fs,bNumber);
+            fs->block_bitmap[bNumber/64] |= 1ULL << (bNumber%64);
+            fs->free_chain_dirty = 1;
+            fs->superBlock.fmod = 1;
+        }
+        return;
+    }
+
+    if(fs->superBlock.nfree == 251){
+        int temp_free[252];
+        int i;
+        //copying 251 and free array into a temp array which we will be writing into bNumber which needs to be freed
+        temp_free[0] = 251;
+        for(i=1;i<252;i++){
+            temp_free[i] = fs->superBlock.free[i-1];
+        }
+
+        //writing the temp_free array into bNumber for it to be reused later
+        getEmptyBlock(fs,bNumber);
+        writeBlockToFS(fs,bNumber,temp_free,sizeof(temp_free));
+        fs->superBlock.nfree = 0;
+
+    }else if(bNumber > 0){
+        scrubBlock(fs,bNumber);
+    }
+
+    //in any case we set the value of free array to bNumber and increase the nfree value
+    fs->superBlock.free[fs->superBlock.nfree] = bNumber;
+    fs->superBlock.nfree++;
+
+    fs->superBlock.fmod = 1;
+}
+
+//freeing a block, on a journaled image it is only put back by the commit of the transaction freeing it
+void addFreeBlock(v6fs_t* fs,int bNumber){
+    if(bNumber > 0 && journaling(fs)){
+        deferFree(fs,bNumber);
+        fs->frees_waiting = 1;
+    }else
+        putFreeBlock(fs,bNumber);
+}
+
+int takeFreeBlock(v6fs_t* fs){
+    if(fs->extent_alloc){
+        int bNumber = getExtentBlock(fs);
+        if(bNumber > 0)
+            V6FS_STAT(fs,blocks_allocated,1);
+        V6FS_DEBUG(fs,"Free Block Number allocated: %d",bNumber);
+        return bNumber;
+    }
+
+    //if no free data block remains, the 0 at the bottom of the last list is left in place
+    if(fs->superBlock.nfree == 0 || fs->superBlock.free[fs->superBlock.nfree-1] == 0)
+        return V6FS_ENOSPC;
+
+    //reducing nfree value by 1
+    fs->superBlock.nfree--;
+    V6FS_STAT(fs,blocks_allocated,1);
+
+    //if nfree becomes 0 we copy the values from next chain, as per the algorithms taught in class
+    if(fs->superBlock.nfree == 0){
+        int bNumber = fs->superBlock.free[0];
+        int chain[252];
+        memcpy(chain,getBlock(fs,bNumber),sizeof(chain));
+        int i;
+        fs->superBlock.nfree = chain[0];
+
+        for(i=1;i<=251;i++)
+            fs->superBlock.free[i-1] = chain[i];
+
+        fs->superBlock.fmod = 1;
+
+        //the committed superblock may still lead to the chain block, it is only handed out after the next commit
+        if(journaling(fs)){
+            deferFree(fs,bNumber);
+            return takeFreeBlock(fs);
+        }
+        V6FS_DEBUG(fs,"Free Block Number allocated: %d",bNumber);
+        return bNumber;
+    }else{
+        fs->superBlock.fmod = 1;
+        V6FS_DEBUG(fs,"Free Block Number allocated: %d",fs->superBlock.free[fs->superBlock.nfree]);
+        return fs->superBlock.free[fs->superBlock.nfree];
+    }
+}
+
+int getFreeBlock(v6fs_t* fs){
+    int bNumber = takeFreeBlock(fs);
+
+    //the blocks of removed files still queued are freed before giving up
+    if(bNumber == V6FS_ENOSPC && reclaimRun(fs,0) > 0)
+        bNumber = takeFreeBlock(fs);
+
+    if(bNumber > 0)
+        punchCancel(fs,bNumber);
+    return bNumber;
+}
+
+//file size is carried in size0 (high 32 bits) and size1 (low 32 bits)
+long long getFileSize(inode_type* inode){
+    return ((long long)inode->size0 << 32) | inode->size1;
+}
+
+void setFileSize(inode_type* inode,long long size){
+    inode->size0 = (unsigned int)(size >> 32);
+    inode->size1 = (unsigned int)size;
+}
+
+void openFile(v6fs_t* fs,open_file_type* file,int iNumber){
+    file->iNumber = iNumber;
+    readInodeFromFS(fs,iNumber,&file->inode);
+    file->ind_block = 0;
+    file->ind_dirty = 0;
+    file->dind_block = 0;
+    file->dind_dirty = 0;
+}
+
+/*
+writeMapBlock() - writes back the entries of a cached indirect block, dirty holds its MAP_DIRTY and MAP_NEW bits
+description: with a journal a block allocated while it was loaded goes straight to the image like file data, only the
+            entry pointing to it is logged. journalCommit(fs) syncs it before the commit block
+*/
+void writeMapBlock(v6fs_t* fs,int bNumber,unsigned int* entries,int dirty){
+    if((dirty & MAP_NEW) == 0 || journaling(fs) == 0){
+        writeBlockToFS(fs,bNumber,entries,BLOCKSIZE);
+        return;
+    }
+    if(journalHolds(fs,bNumber))
+        journalCheckpoint(fs);
+    cacheDiscard(fs,bNumber);
+    pwrite(fs->fd,entries,BLOCKSIZE,(off_t)BLOCKSIZE * bNumber);
+    V6FS_STAT(fs,writes,1);
+    V6FS_STAT(fs,write_bytes,BLOCKSIZE);
+    fs->journal_unsynced = 1;
+}
+
+//writing the cached indirect blocks and the inode back
+void closeFile(v6fs_t* fs,open_file_type* file){
+    if(file->ind_dirty)
+        writeMapBlock(fs,file->ind_block,file->ind,file->ind_dirty);
+    if(file->dind_dirty)
+        writeMapBlock(fs,file->dind_block,file->dind,file->dind_dirty);
+    file->ind_dirty = 0;
+    file->dind_dirty = 0;
+    writeInodeToFS(fs,file->iNumber,&file->inode,sizeof(file->inode));
+}
+
+//loading the entries of an indirect block, bNumber 0 allocates a new zeroed one. Returns the block number or V6FS_ENOSPC
+int loadMapBlock(v6fs_t* fs,int bNumber,int* cached_block,int* cached_dirty,unsigned int* entries){
+    if(bNumber != 0 && bNumber == *cached_block)
+        return bNumber;
+
+    if(*cached_dirty)
+        writeMapBlock(fs,*cached_block,entries,*cached_dirty);
+    *cached_dirty = 0;
+
+    if(bNumber == 0){
+        bNumber = getFreeBlock(fs);
+        if(bNumber < 0)
+            return bNumber;
+        memset(entries,0,BLOCKSIZE);
+        *cached_dirty = MAP_DIRTY | MAP_NEW;
+    }else{
+        memcpy(entries,getBlock(fs,bNumber),BLOCKSIZE);
+    }
+
+    *cached_block = bNumber;
+    return bNumber;
+}
+
+//switching a small file to large by moving its direct blocks into a new indirect block at addr[0]
+int convertToLargeFile(v6fs_t* fs,open_file_type* file){
+    int ind = loadMapBlock(fs,0,&file->ind_block,&file->ind_dirty,file->ind);
+    if(ind < 0)
+        return ind;
+
+    int i;
+    for(i=0;i<9;i++){
+        file->ind[i] = file->inode.addr[i];
+        file->inode.addr[i] = 0;
+    }
+    file->inode.addr[0] = ind;
+    file->inode.flags = file->inode.flags | LARGEFILE;
+    return 1;
+}
+
+/*
+fileBlock() - maps logical block lbn of an open file to its block number
+parameters: file - open file, lbn - logical block number, alloc - 1 to allocate the block (and indirect blocks) if missing
+returns the block number, 0 for an unallocated block when alloc is 0, V6FS_ENOSPC when allocation fails or V6FS_EFBIG
+when lbn is past the largest file
+*/
+int fileBlock(v6fs_t* fs,open_file_type* file,int lbn,int alloc){
+    if((file->inode.flags & LARGEFILE) == 0){
+        if(lbn < 9){
+            if(file->inode.addr[lbn] == 0 && alloc){
+                int bNumber = getFreeBlock(fs);
+                if(bNumber < 0)
+                    return bNumber;
+                file->inode.addr[lbn] = bNumber;
+            }
+            return file->inode.addr[lbn];
+        }
+        if(alloc == 0)
+            return 0;
+        int status = convertToLargeFile(fs,file);
+        if(status < 0)
+            return status;
+    }
+
+    int ind_addr; //block number of the indirect block holding lbn, found in addr[] or in a double indirect block
+    int ind_idx;
+
+    if(lbn < NUM_INDIRECT*PTRS_PER_BLOCK){
+        ind_addr = file->inode.addr[lbn/PTRS_PER_BLOCK];
+        if(ind_addr == 0 && alloc == 0)
+            return 0;
+        ind_addr = loadMapBlock(fs,ind_addr,&file->ind_block,&file->ind_dirty,file->ind);
+        if(ind_addr < 0)
+            return ind_addr;
+        file->inode.addr[lbn/PTRS_PER_BLOCK] = ind_addr;
+    }else{
+        int d = lbn - NUM_INDIRECT*PTRS_PER_BLOCK;
+        int dind_slot = NUM_INDIRECT + d/(PTRS_PER_BLOCK*PTRS_PER_BLOCK);
+        if(dind_slot > 8)
+            return V6FS_EFBIG;
+
+        int dind_addr = file->inode.addr[dind_slot];
+        if(dind_addr == 0 && alloc == 0)
+            return 0;
+        dind_addr = loadMapBlock(fs,dind_addr,&file->dind_block,&file->dind_dirty,file->dind);
+        if(dind_addr < 0)
+            return dind_addr;
+        file->inode.addr[dind_slot] = dind_addr;
+
+        int dind_idx = (d/PTRS_PER_BLOCK) % PTRS_PER_BLOCK;
+        ind_addr = file->dind[dind_idx];
+        if(ind_addr == 0 && alloc == 0)
+            return 0;
+        ind_addr = loadMapBlock(fs,ind_addr,&file->ind_block,&file->ind_dirty,file->ind);
+        if(ind_addr < 0)
+            return ind_addr;
+        if(file->dind[dind_idx] != (unsigned int)ind_addr){
+            file->dind[dind_idx] = ind_addr;
+            file->dind_dirty |= MAP_DIRTY;
+        }
+    }
+
+    ind_idx = lbn % PTRS_PER_BLOCK;
+    if(file->ind[ind_idx] == 0 && alloc){
+        int bNumber = getFreeBlock(fs);
+        if(bNumber < 0)
+            return bNumber;
+        file->ind[ind_idx] = bNumber;
+        file->ind_dirty |= MAP_DIRTY;
+    }
+    return file->ind[ind_idx];
+}
+
+//freeing the data blocks listed in an indirect block and then the indirect block itself, returns the number of blocks freed
+int freeIndirectBlock(v6fs_t* fs,int bNumber,int depth){
+    unsigned int entries[256];
+    memcpy(entries,getBlock(fs,bNumber),BLOCKSIZE); //copied since freeing blocks below may evict it
+
+    int freed = 1;
+    int i;
+    for(i=0;i<PTRS_PER_BLOCK;i++){
+        if(entries[i] == 0)
+            continue;
+        if(depth > 1){
+            freed += freeIndirectBlock(fs,entries[i],depth-1);
+        }else{
+            addFreeBlock(fs,entries[i]);
+            freed++;
+        }
+    }
+
+    addFreeBlock(fs,bNumber);
+    return freed;
+}
+
+//freeing what addr[i] of an inode with these flags points to, returns the number of blocks freed
+int freeAddr(v6fs_t* fs,int bNumber,int flags,int i){
+    if(bNumber == 0)
+        return 0;
+    if(flags & LARGEFILE)
+        return freeIndirectBlock(fs,bNumber,i < NUM_INDIRECT ? 1 : 2);
+    addFreeBlock(fs,bNumber);
+    return 1;
+}
+
+//freeing every block of a file, its addr[] entries are set to 0
+void freeFileBlocks(v6fs_t* fs,inode_type* inode){
+    int i;
+    for(i=0;i<9;i++){
+        freeAddr(fs,inode->addr[i],inode->flags,i);
+        inode->addr[i] = 0;
+    }
+    inode->flags = inode->flags & ~LARGEFILE;
+}
+
+/*
+initfs() - formats the opened image with totalBlocks blocks of which totalInodeBlocks hold inodes
+description: the image is truncated and regrown to its full size, so the inode table and the data blocks
+            read as zeros without being written. Only the free chain blocks, the root directory and the
+            superblock are written
+*/
+int initfs(v6fs_t* fs,int totalBlocks,int totalInodeBlocks){
+
+    //the journal is taken from the end of the image, the same minimum of data blocks must be left
+    int journalBlocks = fs->journal_format_blocks;
+    if(journalBlocks > 0 && journalBlocks < journalMinBlocks(totalBlocks))
+        journalBlocks = journalMinBlocks(totalBlocks);
+    if(journalBlocks > 0 && totalBlocks - journalBlocks < totalInodeBlocks + 3)
+        return V6FS_EINVAL;
+
+    //cached or mapped blocks belong to the old contents of the image, so do the blocks freed or queued so far
+    reclaimDestroy(fs);
+    cacheDestroy(fs);
+    dentryClear(fs);
+    unmapImage(fs);
+    journalClose(fs); //formatting is not journaled, a new journal is set up once the file system is written
+
+    ftruncate(fs->fd,0);
+    ftruncate(fs->fd,(off_t)BLOCKSIZE * totalBlocks);
+
+    //initializing superblock with appropriate values
+    fs->superBlock.isize = totalInodeBlocks;
+    fs->superBlock.fsize = totalBlocks;
+    fs->superBlock.flock = 'x';
+    fs->superBlock.ilock = 'x';
+    fs->superBlock.fmod = 1;
+    fs->superBlock.time = (int)time(NULL); //unix epoch time
+    fs->superBlock.nfree = 0;
+
+    //block totalInodeBlocks+1 is the last inode block, data blocks start right after it
+    allocBlockBitmap(fs,totalBlocks);
+    int bNumber;
+    for(bNumber = totalInodeBlocks + 2;bNumber<totalBlocks - journalBlocks;bNumber++)
+        fs->block_bitmap[bNumber/64] |= 1ULL << (bNumber%64);
+    writeFreeChain(fs);
+    if(fs->extent_alloc == 0){
+        free(fs->block_bitmap);
+        fs->block_bitmap = NULL;
+    }
+
+    //in mmap mode everything below is written through the mapping
+    if(fs->mmap_mode)
+        mapImage(fs,totalBlocks);
+
+    getEmptyBlock(fs,1);
+    flushSuperBlock(fs);
+
+    buildInodeBitmap(fs);
+
+    int status = allocateNewInodeToDir(fs,1,1); //allocating inode 1 as root
+    if(status < 0)
+        return status;
+    readInodeFromFS(fs,1,&fs->root_inode);
+    fs->curr_inode = 1;
+
+    if(journalBlocks > 0){
+        syncFS(fs);
+        journalFormat(fs,journalBlocks);
+    }
+
+    return V6FS_OK;
+}
+
+//returns 1 when the directory inode_curr already has an entry name. A miss leaves the free entry dirLookup() saw as
+//the hint for the dirFreeSlot() that follows
+int nameExists(v6fs_t* fs,int inode_curr,char* name){
+    //a cached entry answers the duplicate check without reading the directory
+    if(dentryLookup(fs,inode_curr,name) > 0)
+        return 1;
+
+    int existing = dirLookup(fs,inode_curr,name);
+    if(existing == -1)
+        return 0;
+    dentryInsert(fs,inode_curr,name,existing,fs->addr_dir);
+    return 1;
+}
+
+/*
+makedir() - function to create a new directory
+parameters : dir_name - directory name to be created, inode_curr - curr_inode where the directory needs to be created
+we look dir_name up in inode_curr with dirLookup() and create a new entry in the free 32 bytes dirFreeSlot() finds
+we allocate a new inode to directory using allocateNewInodeToDir()
+*/
+
+int makedir(v6fs_t* fs,char* dir_name,int inode_curr){
+
+    if(strlen(dir_name) > 28)
+        return V6FS_ENAMETOOLONG;
+
+    if(nameExists(fs,inode_curr,dir_name))
+        return V6FS_EEXIST;
+
+    //a directory without a free entry is given a new block here, it stays attached if the inode allocation fails
+    long long addr = dirFreeSlot(fs,inode_curr,dir_name);
+    if(addr < 0)
+        return addr;
+
+    int new_inode = allocateNewInodeToDir(fs,-1,inode_curr);
+    if(new_inode < 0)
+        return new_inode;
+
+    //writing the entry and accounting the additional 32 bytes in the size of inode_curr
+    dirSetEntry(fs,inode_curr,addr,dir_name,new_inode);
+    dentryInsert(fs,inode_curr,dir_name,new_inode,addr);
+
+    return 1;
+}
+
+/*
+path_to_inode() - this is a utility function to navigate and resolve a path to its inode
+paramteres - ppath - path that needs to be parsed, curr_inode_temp - if explicitly there is a need to specify the curr_inode
+*/
+
+int path_to_inode(v6fs_t* fs,char* ppath,int curr_inode_temp){
+    char path[256];
+    int i;
+    int count = 0; //stores the number of parts in a path
+    int len = strlen(ppath);
+    if(len == 0 || len >= 256)
+        return -1;
+    for(i=0;i<len;i++){
+        path[i] = ppath[i];
+        if(i>0 && path[i] == '/')
+            count++;
+    }
+    path[i] = '\0';
+
+    int curr;
+
+    if(curr_inode_temp!=-1)
+        curr = curr_inode_temp;
+    else
+        curr = fs->curr_inode;
+
+    if(path[len-1]!='/')
+        count++;
+
+    i = 0;
+
+    if(path[0] == '/'){
+        curr= 1;
+        i++;
+    }
+
+    char dir[29]; //dir stores the current directory in consideration
+    int h = 0;
+
+    while(path[i]!='/' && i<len){
+        dir[h] = path[i];
+        i++;
+        h++;
+    }
+    dir[h] = '\0';
+    i++;
+
+    //this loop will pick all the directories in parts splitted by '/' and then look for that directory in curr directory
+    //we then modify the curr directory to the inode of that directory in case it is found
+
+    while(dir != NULL && count>0) {
+        //a cached lookup skips reading both the inode and the directory blocks
+        int cached = dentryLookup(fs,curr,dir);
+        if(cached == -1)
+            return -1;
+
+        if(cached > 0){
+            V6FS_STAT(fs,dentry_hits,1);
+            curr = cached;
+            int h = 0;
+            while(path[i]!='/' && i<len){
+                dir[h] = path[i];
+                i++;
+                h++;
+            }
+            i++;
+            dir[h] = '\0';
+            count--;
+            continue;
+        }
+
+        //needs to be checked if the curr directory which is being looked at is a directory or not
+        icache_entry_type* curr_inode = inodeGet(fs,curr);
+        int check_dir = curr_inode->flags & (1<<14);
+        int check_dir2 = curr_inode->flags & (1<<13);
+        inodePut(fs,curr_inode);
+        int flag_found = 0;
+
+        if(check_dir == 16384 &&  check_dir2 == 0){
+            int found = dirLookup(fs,curr,dir); //sets addr_dir and addr_inode
+            if(found != -1){
+                curr = found;
+                flag_found = 1;
+            }
+        }
+
+        if(flag_found == 0){ //if we didn't find dir then the address is not valid
+            if(check_dir == 16384 && check_dir2 == 0)
+                dentryInsert(fs,curr,dir,-1,0);
+            return -1;
+        }
+
+        dentryInsert(fs,fs->addr_inode,dir,curr,fs->addr_dir);
+
+        int h = 0;
+        while(path[i]!='/' && i<len){
+            dir[h] = path[i];
+            i++;
+            h++;
+        }
+        i++;
+        dir[h] = '\0';
+        count--;
+    }
+    return curr;
+}
+
+//freeing the blocks and the inode of the plain file iNumber read into inode, its name is removed by the caller
+void removeFile(v6fs_t* fs,int iNumber,inode_type* inode){
+    //freeing all blocks and setting all addr of the inode to default value, or leaving them to reclaimRun(fs)
+    if(fs->lazy_free)
+        reclaimQueue(fs,inode);
+    else
+        freeFileBlocks(fs,inode);
+
+    inode->flags = 0;
+    inode->size0 = 0;
+    inode->size1 = 0;
+    inode->nlinks = 0;
+    inode->uid = 0;
+    inode->gid = 0;
+    inode->actime = 0;
+    inode->modtime = 0;
+
+    //unallocating the inode
+    writeInodeToFS(fs,iNumber,inode,sizeof(inode_type));
+    releaseInode(fs,iNumber);
+    V6FS_DEBUG(fs,"Inode Number: %d deemed unallocated",iNumber);
+}
+
+/*
+rm() - used to delete a file,returns V6FS_EINVAL if trying to delete a directory
+paramteres - path of the file which needs to be deleted
+description:    we need to parse the given path to find the parent inode of the directory entry which needs to be deleted
+                we also need to fetch the inode of the file which needs to deleted
+*/
+int rm(v6fs_t* fs,char* path){ //addr_dir = address in bytes where the directory entry is present
+
+    int curr = path_to_inode(fs,path,-1);
+
+    //a file a bulk export is copying is removed once it is copied, the path is looked up again then
+    while(curr != -1 && inodePinned(fs,curr)){
+        pthread_cond_wait(&fs->bulk_done,&fs->lock);
+        curr = path_to_inode(fs,path,-1);
+    }
+
+    if(curr == -1)
+        return V6FS_ENOENT;
+
+    //reading the current inode whihc needs to be deleted
+    inode_type temp_inode;
+    readInodeFromFS(fs,curr,&temp_inode);
+
+    //reading the parent inode of the file which needs to be delted
+    inode_type parent_inode;
+    readInodeFromFS(fs,fs->addr_inode,&parent_inode);
+
+    //checking if the given path corresponds to a file, bits 14-13 are 10 for a directory and bit 12 only marks a large file
+    int if_dir = temp_inode.flags & 1<<14;
+    int if_file2 = temp_inode.flags & 1<<13;
+
+    if(if_dir || if_file2)
+        return V6FS_EINVAL;
+
+    removeFile(fs,curr,&temp_inode);
+
+    //setting the directory entry in the parent inode as unused with null filename
+    dir_type* directory = (dir_type*)(getBlock(fs,fs->addr_dir/BLOCKSIZE) + fs->addr_dir%BLOCKSIZE);
+    dentryInvalidate(fs,fs->addr_inode,directory->filename);
+    dentryInvalidateParent(fs,curr);
+    directory->inode = -1;
+    memset(directory->filename,'\0',sizeof(directory->filename));
+    markBlockDirty(fs,fs->addr_dir/BLOCKSIZE);
+
+    //reducing the parent inode size
+    parent_inode.size1 = parent_inode.size1 - 32;
+    writeInodeToFS(fs,fs->addr_inode,&parent_inode,sizeof(parent_inode));
+
+    return 1; //successfully deleted;
+
+}
+
+//allocating the inode of an empty plain file of size bytes, which is in no directory until linkFile() names it
+int newFileInode(v6fs_t* fs,long long size){
+    int free_inode = findUnallocatedInode(fs);
+    if(free_inode < 0)
+        return free_inode;
+
+    inode_type newInode;
+    readInodeFromFS(fs,free_inode,&newInode);
+    //1(allocated)00(plain file)00(small file)0(uid)0(gid)111(rwx for owner)101(rx for group)100(read for everyone)
+    newInode.flags = 33260;
+    setFileSize(&newInode,size); //size of the inode equal to extFile size
+    newInode.nlinks = 1;
+    newInode.actime = (int)time(NULL);
+    newInode.modtime = (int)time(NULL);
+
+    //the block map switches the file to large mode with indirect blocks once it passes 9 blocks
+    memset(newInode.addr,0,sizeof(newInode.addr));
+    writeInodeToFS(fs,free_inode,&newInode,sizeof(newInode));
+    return free_inode;
+}
+
+//adding the name intFile for the inode iNumber to the directory inode_curr, V6FS_EEXIST when the name is taken
+int linkFile(v6fs_t* fs,char* intFile,int inode_curr,int iNumber){
+    if(nameExists(fs,inode_curr,intFile))
+        return V6FS_EEXIST;
+
+    //the lookup result cached for this name, possibly negative, is about to change
+    dentryInvalidate(fs,inode_curr,intFile);
+
+    //the directory is given a new block first when it has no free entry
+    long long addr = dirFreeSlot(fs,inode_curr,intFile);
+    if(addr < 0)
+        return addr;
+
+    //setting the directory entry and changing the size of the parent inode to include it
+    dirSetEntry(fs,inode_curr,addr,intFile,iNumber);
+    return V6FS_OK;
+}
+
+//blocks reserved in extent mode for a file of file_blocks data blocks, including the indirect blocks a large file needs
+int fileReservation(int file_blocks){
+    return file_blocks + (file_blocks > 9 ? file_blocks/PTRS_PER_BLOCK + 3 : 0);
+}
+
+/*
+cpin() - used to copy external file to internal v6 filesystem
+parameters: extFile - path to external file, intFile - intFile name;
+            inode_curr - inode of the directory where the files needs to stored
+description: the inode is allocated with newFileInode() and only the blocks of extFile holding something else than
+            zeros are allocated, the others are left as holes. Without a ring they are read, checked and written a piece
+            at a time by streamIn(). With one, they are found by fileDataMap() first, all allocated by fileRuns() and then
+            copied into the runs of consecutive blocks by copyRunsIn(). The file is named by linkFile() once its data is
+            written, a failed copy frees it again
+*/
+int cpin(v6fs_t* fs,char* extFile,char* intFile,int inode_curr){
+
+    //an existing name fails before anything is copied, linkFile() checks it again
+    if(strlen(intFile) > 28)
+        return V6FS_ENAMETOOLONG;
+    if(nameExists(fs,inode_curr,intFile))
+        return V6FS_EEXIST;
+
+    int fde = open(extFile, O_RDONLY);
+    if(fde == -1)
+        return V6FS_EIO;
+
+    struct stat st;
+    fstat(fde, &st);
+
+    //a hole at the end is never allocated, so the limit is checked on the size
+    if((st.st_size + BLOCKSIZE - 1)/BLOCKSIZE > MAX_FILE_BLOCKS){
+        close(fde);
+        return V6FS_EFBIG;
+    }
+
+    unsigned long long* data_map = NULL;
+    int status = fs->ring != NULL ? fileDataMap(fs,fde,&st,&data_map) : V6FS_OK;
+    if(status < 0){
+        close(fde);
+        return status;
+    }
+
+    int free_inode = newFileInode(fs,st.st_size);
+    if(free_inode < 0){
+        free(data_map);
+        close(fde);
+        return free_inode;
+    }
+
+    if(fs->ring == NULL){
+        char* buf = malloc(STREAM_BUFSIZE + BLOCKSIZE);
+        status = streamIn(fs,fde,&st,free_inode,buf);
+        free(buf);
+    }else{
+        block_run_type* runs;
+        status = fileRuns(fs,free_inode,1,data_map,0,INT_MAX,&runs);
+        if(status >= 0){
+            status = copyRunsIn(fs,fde,st.st_size,runs,status,0,INT_MAX,fs->ring,NULL);
+            free(runs);
+        }
+    }
+
+    if(status >= 0)
+        status = linkFile(fs,intFile,inode_curr,free_inode);
+    if(status < 0){
+        inode_type inode;
+        readInodeFromFS(fs,free_inode,&inode);
+        removeFile(fs,free_inode,&inode);
+    }else if(journaling(fs)){
+        fs->journal_unsynced = 1; //the data reaches the disk before the commit naming the file
+    }
+    free(data_map);
+    close(fde);
+    V6FS_DEBUG(fs,"Num Bytes read:%lld",(long long)st.st_size);
+
+    return status;
+}
+
+/*
+fileRuns() - lists the data blocks of the file iNumber as runs of physically consecutive blocks
+parameters: alloc - 1 to allocate the blocks of a file created by newFileInode(), 0 to list the blocks already
+            allocated, leaving out holes. data_map - with alloc, a bitmap with bit lbn-lbn_start set for the blocks to
+            allocate, the others are left as holes. NULL allocates every block. Blocks lbn_start to lbn_end-1 are listed
+description: *runs is set to a malloc'ed array of the runs which the caller frees. Allocated blocks are dropped
+            from the block cache so the runs can be written with pwrite. Returns the number of runs or a negative error code
+*/
+int fileRuns(v6fs_t* fs,int iNumber,int alloc,unsigned long long* data_map,int lbn_start,int lbn_end,block_run_type** runs){
+    open_file_type file;
+    openFile(fs,&file,iNumber);
+
+    int num_blocks = (getFileSize(&file.inode) + BLOCKSIZE - 1)/BLOCKSIZE;
+    if(lbn_end > num_blocks)
+        lbn_end = num_blocks;
+
+    if(alloc){
+        int num_data = lbn_end - lbn_start;
+        if(data_map != NULL){
+            int w;
+            num_data = 0;
+            for(w=0;w<(lbn_end-lbn_start+63)/64;w++)
+                num_data += __builtin_popcountll(data_map[w]);
+        }
+        reserveBlocks(fs,fileReservation(num_data));
+    }
+
+    int capacity = 16;
+    int num_runs = 0;
+    *runs = malloc(sizeof(block_run_type) * capacity);
+
+    int lbn;
+    for(lbn=lbn_start;lbn<lbn_end;lbn++){
+        int bit = lbn - lbn_start;
+        if(alloc && data_map != NULL && (data_map[bit/64] & (1ULL << (bit%64))) == 0)
+            continue;
+        int bNumber = fileBlock(fs,&file,lbn,alloc);
+        if(bNumber < 0){
+            num_runs = bNumber;
+            break;
+        }
+        if(bNumber == 0)
+            continue;
+        if(alloc){
+            cacheDiscard(fs,bNumber);
+            if(journalHolds(fs,bNumber))
+                journalCheckpoint(fs);
+        }
+
+        if(num_runs > 0 && (*runs)[num_runs-1].bNumber + (*runs)[num_runs-1].len == bNumber
+            && (*runs)[num_runs-1].lbn + (*runs)[num_runs-1].len == lbn){
+            (*runs)[num_runs-1].len++;
+            continue;
+        }
+        if(num_runs == capacity){
+            capacity = capacity*2;
+            *runs = realloc(*runs,sizeof(block_run_type) * capacity);
+        }
+        (*runs)[num_runs].lbn = lbn;
+        (*runs)[num_runs].bNumber = bNumber;
+        (*runs)[num_runs].len = 1;
+        num_runs++;
+    }
+
+    if(alloc){
+        releaseReservation(fs);
+        closeFile(fs,&file);
+    }
+
+    if(num_runs < 0){
+        free(*runs);
+        *runs = NULL;
+    }
+    return num_runs;
+}
+
+/*
+copyRunsIn() - copies blocks lbn_start to lbn_end-1 of the external file fde of size bytes into their runs in the image
+description: each run is written with whole blocks, the tail of the last block is zero filled. With a ring the runs
+            are queued on it as linked reads and writes, otherwise they are copied through buf of STREAM_BUFSIZE bytes
+*/
+int copyRunsIn(v6fs_t* fs,int fde,long long size,block_run_type* runs,int num_runs,int lbn_start,int lbn_end,uring_type* ring,char* buf){
+    copy_segment_type* segs = ring != NULL ? malloc(sizeof(copy_segment_type) * (num_runs + 1)) : NULL;
+    int num_segs = 0;
+    int i;
+
+    for(i=0;i<num_runs;i++){
+        block_run_type* run = &runs[i];
+        int first = run->lbn > lbn_start ? run->lbn : lbn_start;
+        int last = run->lbn + run->len < lbn_end ? run->lbn + run->len : lbn_end;
+        if(first >= last)
+            continue;
+
+        if(segs != NULL){
+            copy_segment_type* seg = &segs[num_segs++];
+            seg->in_fd = fde;
+            seg->in_off = (off_t)BLOCKSIZE*first;
+            seg->out_len = (long long)(last - first)*BLOCKSIZE;
+            seg->in_len = seg->in_off + seg->out_len > size ? size - seg->in_off : seg->out_len;
+            seg->out_fd = fs->fd;
+            seg->out_off = (off_t)BLOCKSIZE*(run->bNumber + first - run->lbn);
+            continue;
+        }
+
+        while(first < last){
+            int num_blocks = last - first;
+            if(num_blocks > STREAM_BUFSIZE/BLOCKSIZE)
+                num_blocks = STREAM_BUFSIZE/BLOCKSIZE;
+
+            size_t want = (size_t)num_blocks*BLOCKSIZE;
+            if((long long)first*BLOCKSIZE + (long long)want > size)
+                want = size - (long long)first*BLOCKSIZE;
+
+            size_t got = 0;
+            while(got < want){
+                ssize_t n = pread(fde,buf + got,want - got,(off_t)BLOCKSIZE*first + got);
+                V6FS_STAT(fs,reads,1);
+                if(n <= 0)
+                    break;
+                got = got + n;
+            }
+            memset(buf + got,0,(size_t)num_blocks*BLOCKSIZE - got);
+            V6FS_STAT(fs,read_bytes,got);
+
+            off_t image_off = (off_t)BLOCKSIZE*(run->bNumber + first - run->lbn);
+            V6FS_STAT(fs,writes,1);
+            if(pwrite(fs->fd,buf,(size_t)num_blocks*BLOCKSIZE,image_off) != (ssize_t)num_blocks*BLOCKSIZE)
+                return V6FS_EIO;
+            V6FS_STAT(fs,write_bytes,(size_t)num_blocks*BLOCKSIZE);
+            first = first + num_blocks;
+        }
+    }
+
+    int status = V6FS_OK;
+    if(segs != NULL){
+        status = uringCopy(ring,segs,num_segs);
+        V6FS_STAT(fs,copies,num_segs);
+        for(i=0;i<num_segs;i++)
+            V6FS_STAT(fs,copy_bytes,segs[i].out_len);
+        free(segs);
+    }
+    return status;
+}
+
+/*
+copyImageRange() - copies len bytes at in_off in the image to out_off in the external file fde
+description: uses copy_file_range so the data never passes through user space, falling back to sendfile and
+            then to copying through ring, or a pread/pwrite loop without one, when the kernel or the file systems
+            involved don't support it
+*/
+int copyImageRange(v6fs_t* fs,int fde,off_t in_off,off_t out_off,long long len,uring_type* ring){
+    while(len > 0){
+        ssize_t n = copy_file_range(fs->fd,&in_off,fde,&out_off,len,0);
+        V6FS_STAT(fs,copies,1);
+        if(n <= 0)
+            break;
+        V6FS_STAT(fs,copy_bytes,n);
+        len = len - n;
+    }
+
+    if(len > 0){
+        lseek(fde,out_off,SEEK_SET);
+        V6FS_STAT(fs,seeks,1);
+        while(len > 0){
+            ssize_t n = sendfile(fde,fs->fd,&in_off,len);
+            V6FS_STAT(fs,copies,1);
+            if(n <= 0)
+                break;
+            V6FS_STAT(fs,copy_bytes,n);
+            out_off = out_off + n;
+            len = len - n;
+        }
+    }
+
+    if(len > 0 && ring != NULL){
+        copy_segment_type seg = {fs->fd,in_off,len,fde,out_off,len};
+        V6FS_STAT(fs,copies,1);
+        V6FS_STAT(fs,copy_bytes,len);
+        return uringCopy(ring,&seg,1) < 0 ? -1 : 1;
+    }
+
+    if(len > 0){
+        char* buf = malloc(STREAM_BUFSIZE);
+        while(len > 0){
+            ssize_t n = pread(fs->fd,buf,len < STREAM_BUFSIZE ? len : STREAM_BUFSIZE,in_off);
+            V6FS_STAT(fs,reads,1);
+            if(n <= 0)
+                break;
+            V6FS_STAT(fs,read_bytes,n);
+            V6FS_STAT(fs,writes,1);
+            if(pwrite(fde,buf,n,out_off) != n)
+                break;
+            V6FS_STAT(fs,write_bytes,n);
+            in_off = in_off + n;
+            out_off = out_off + n;
+            len = len - n;
+        }
+        free(buf);
+    }
+
+    return len > 0 ? -1 : 1;
+}
+
+/*
+cpout() - copy from internal filesystem to external filesystem
+parameteres: extFile - externalFile path; intFile - internalFile path
+description - we move to the inode of the intFile path and copy all the data blocks represented by addr to extFile
+*/
+int cpout(v6fs_t* fs,char* extFile,char* intFile){
+    int inode_curr = path_to_inode(fs,intFile,-1); //fetching the inode to intFile
+    V6FS_DEBUG(fs,"Inode for Int file:%d",inode_curr);
+
+    if(inode_curr == -1)
+        return V6FS_ENOENT;
+
+    int fde = open(extFile, O_CREAT | O_RDWR | O_TRUNC, 0644); //opening the external file to write contents
+    if(fde == -1)
+        return V6FS_EIO;
+
+    open_file_type file;
+    openFile(fs,&file,inode_curr);
+
+    long long sz = getFileSize(&file.inode); //storing the file size in a temp variable
+    int num_blocks = (sz + BLOCKSIZE - 1)/BLOCKSIZE;
+    int status = 1;
+
+    /*
+        the block map is walked once and physically consecutive blocks are grouped into runs, each copied
+        from the image to the external file in the kernel by copyImageRange(). Data blocks are never held dirty
+        in the block cache (cpin writes them directly), so the image already has their contents.
+        Unallocated blocks are skipped, the final ftruncate leaves them as zeros
+    */
+    int run_start = 0; //first block of the current run and the logical block it starts at
+    int run_lbn = 0;
+    int run_len = 0;
+    int lbn;
+
+    for(lbn=0;lbn<=num_blocks;lbn++){
+        int bNumber = 0;
+        if(lbn < num_blocks)
+            bNumber = fileBlock(fs,&file,lbn,0);
+
+        if(run_len > 0 && (bNumber != run_start + run_len || lbn == num_blocks)){
+            long long len = (long long)run_len*BLOCKSIZE;
+            if((long long)run_lbn*BLOCKSIZE + len > sz)
+                len = sz - (long long)run_lbn*BLOCKSIZE;
+            if(copyImageRange(fs,fde,(off_t)BLOCKSIZE * run_start,(off_t)BLOCKSIZE * run_lbn,len,fs->ring) == -1)
+                status = V6FS_EIO;
+            run_len = 0;
+        }
+
+        if(bNumber > 0){
+            if(run_len == 0){
+                run_start = bNumber;
+                run_lbn = lbn;
+            }
+            run_len++;
+        }
+    }
+
+    ftruncate(fde,sz);
+    close(fde);
+
+    //updating access time
+    file.inode.actime = (int)time(NULL);
+    closeFile(fs,&file);
+
+    return status;
+}
+
+//utility function to process the path to split the path with '/' delimeter, the last part of the path is copied to last_dir
+int process_path(v6fs_t* fs,char* path,char* last_dir){
+    int len = strlen(path);
+
+    int k=0;
+    if(path[0] == '/')
+        k++;
+    int count = 1;
+    for(;k<len;k++){
+        if(path[k] == '/')
+            count++;
+    }
+
+    int i=len-1;
+    while(i>=0 && path[i]!='/'){
+        i--;
+    }
+
+    char temp[256];
+
+    int j=0;
+    while(j<i){
+        temp[j] = path[j];
+        j++;
+    }
+
+    temp[j] = '\0';
+
+    int idx = 0;
+    while((i+1)<len){
+        i++;
+        last_dir[idx++] = path[i];
+    }
+    last_dir[idx] = '\0';
+
+    if(count == 1){
+        if(path[0] == '/'){
+            return 1;
+        }else{
+            return fs->curr_inode;
+        }
+    }
+
+    return path_to_inode(fs,temp,-1); //returns the inode of the path
+}
+
+
+/*
+Public interface
+every call takes the handle lock, checks the image is formatted where it needs to be and maps the
+internal results onto the V6FS_* codes of v6fs.h
+*/
+
+//end of call sync point for the superblock, with a journal also reached early when the next call might not fit in the
+//transaction being grouped
+void endCall(v6fs_t* fs){
+    fs->commands_since_sync++;
+    int full = 0;
+    if(journaling(fs)){
+        icacheFlush(fs); //only copies the inodes into cached blocks, which are counted in the room left
+        full = journalRoom(fs) < JOURNAL_CALL_BLOCKS;
+    }
+    if(full || (fs->superblock_sync_interval > 0 && fs->commands_since_sync >= fs->superblock_sync_interval)){
+        icacheFlush(fs); //inode changes go out with the same commit as the blocks they refer to
+        if(journaling(fs)){
+            journalCommit(fs);
+            reclaimCommitted(fs);
+            reclaimRun(fs,RECLAIM_BATCH); //these go out with the next commit
+        }else{
+            reclaimRun(fs,RECLAIM_BATCH);
+            flushSuperBlock(fs);
+        }
+        punchFlush(fs);
+        fs->commands_since_sync = 0;
+    }
+}
+
+//paths are copied since the path functions work on a char* and on buffers of at most 256 bytes, every name in them
+//has to fit the 28 characters of a directory entry
+int copyPath(char* dst,const char* src){
+    if(src == NULL || src[0] == '\0')
+        return V6FS_EINVAL;
+    if(strlen(src) >= 256)
+        return V6FS_ENAMETOOLONG;
+
+    int name_len = 0;
+    const char* c;
+    for(c=src;*c!='\0';c++){
+        name_len = *c == '/' ? 0 : name_len + 1;
+        if(name_len > 28)
+            return V6FS_ENAMETOOLONG;
+    }
+    strcpy(dst,src);
+    return V6FS_OK;
+}
+
+v6fs_t* v6fs_open(const char* path,int flags,int* err){
+    v6fs_t* fs = calloc(1,sizeof(v6fs_t));
+    int status = V6FS_EIO;
+
+    if(fs != NULL){
+        pthread_mutex_init(&fs->lock,NULL);
+        pthread_cond_init(&fs->bulk_done,NULL);
+        fs->fd = -1;
+        fs->curr_inode = -1;
+        fs->cache_capacity = 256;
+        fs->superblock_sync_interval = 1;
+        fs->log_level = V6FS_LOG_QUIET;
+        fs->log_out = stderr;
+        fs->dir_match = dirMatchSelect();
+        fs->zero_check = zeroCheckSelect();
+
+        status = path == NULL ? V6FS_EINVAL : openImage(fs,path,flags);
+        if(status < 0){
+            if(fs->fd != -1)
+                close(fs->fd);
+            cacheDestroy(fs);
+            journalClose(fs);
+            free(fs->inode_bitmap);
+            free(fs->block_bitmap);
+            pthread_cond_destroy(&fs->bulk_done);
+            pthread_mutex_destroy(&fs->lock);
+            free(fs);
+            fs = NULL;
+        }
+    }
+
+    if(err != NULL)
+        *err = status < 0 ? status : V6FS_OK;
+    return fs;
+}
+
+int v6fs_format(v6fs_t* fs,int total_blocks,int inode_blocks){
+    //the superblock, the root directory and at least one inode block must fit
+    if(inode_blocks < 1 || total_blocks < inode_blocks + 3 || total_blocks >= V6FS_MAX_BLOCKS)
+        return V6FS_EINVAL;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    bulkWait(fs);
+    int status = initfs(fs,total_blocks,inode_blocks);
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_FORMAT,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status < 0 ? status : V6FS_OK;
+}
+
+int v6fs_close(v6fs_t* fs){
+    pthread_mutex_lock(&fs->lock);
+    bulkWait(fs);
+    syncFS(fs);
+    cacheDestroy(fs);
+    unmapImage(fs);
+    journalCheckpoint(fs);
+    journalClose(fs);
+    dentryClear(fs);
+    uringDestroy(fs->ring);
+    int status = close(fs->fd) == -1 ? V6FS_EIO : V6FS_OK;
+    free(fs->inode_bitmap);
+    free(fs->block_bitmap);
+    free(fs->pinned);
+    reclaimDestroy(fs);
+    pthread_mutex_unlock(&fs->lock);
+
+    pthread_cond_destroy(&fs->bulk_done);
+    pthread_mutex_destroy(&fs->lock);
+    free(fs);
+    return status;
+}
+
+int v6fs_sync(v6fs_t* fs){
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    syncFS(fs);
+    fs->commands_since_sync = 0;
+    statsRecord(fs,V6FS_OP_SYNC,start);
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+int v6fs_mkdir(v6fs_t* fs,const char* path){
+    char buf[256];
+    char last_dir[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    if(fs->superBlock.fsize == 0)
+        status = V6FS_ENOTFORMATTED;
+    else{
+        journalReserve(fs,JOURNAL_CALL_BLOCKS);
+        int inode_curr = process_path(fs,buf,last_dir);
+        if(inode_curr == -1)
+            status = V6FS_ENOENT;
+        else
+            status = makedir(fs,last_dir,inode_curr);
+    }
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_MKDIR,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status < 0 ? status : V6FS_OK;
+}
+
+int v6fs_cpin(v6fs_t* fs,const char* ext_path,const char* path){
+    char buf[256];
+    char last_dir[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+    if(ext_path == NULL)
+        return V6FS_EINVAL;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    if(fs->superBlock.fsize == 0)
+        status = V6FS_ENOTFORMATTED;
+    else{
+        journalReserve(fs,JOURNAL_CALL_BLOCKS);
+        int inode_curr = process_path(fs,buf,last_dir);
+        if(inode_curr == -1)
+            status = V6FS_ENOENT;
+        else
+            status = cpin(fs,(char*)ext_path,last_dir,inode_curr);
+    }
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_CPIN,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status < 0 ? status : V6FS_OK;
+}
+
+int v6fs_cpout(v6fs_t* fs,const char* path,const char* ext_path){
+    char buf[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+    if(ext_path == NULL)
+        return V6FS_EINVAL;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    if(fs->superBlock.fsize == 0)
+        status = V6FS_ENOTFORMATTED;
+    else
+        status = cpout(fs,(char*)ext_path,buf);
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_CPOUT,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status < 0 ? status : V6FS_OK;
+}
+
+int v6fs_rm(v6fs_t* fs,const char* path){
+    char buf[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    if(fs->superBlock.fsize == 0)
+        status = V6FS_ENOTFORMATTED;
+    else
+        status = rm(fs,buf);
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_RM,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status < 0 ? status : V6FS_OK;
+}
+
+int v6fs_lookup(v6fs_t* fs,const char* path){
+    char buf[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    if(fs->superBlock.fsize == 0)
+        status = V6FS_ENOTFORMATTED;
+    else{
+        status = path_to_inode(fs,buf,-1);
+        if(status == -1)
+            status = V6FS_ENOENT;
+    }
+    statsRecord(fs,V6FS_OP_LOOKUP,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status;
+}
+
+int v6fs_chdir(v6fs_t* fs,const char* path){
+    char buf[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    if(fs->superBlock.fsize == 0)
+        status = V6FS_ENOTFORMATTED;
+    else{
+        status = path_to_inode(fs,buf,-1);
+        if(status == -1)
+            status = V6FS_ENOENT;
+        else
+            fs->curr_inode = status;
+    }
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_CHDIR,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status;
+}
+
+int v6fs_set_cache_size(v6fs_t* fs,int num_blocks){
+    pthread_mutex_lock(&fs->lock);
+    setCacheSize(fs,num_blocks);
+    int capacity = fs->cache_capacity;
+    endCall(fs);
+    pthread_mutex_unlock(&fs->lock);
+    return capacity;
+}
+
+int v6fs_set_alloc_mode(v6fs_t* fs,int mode){
+    if(mode != V6FS_ALLOC_LIST && mode != V6FS_ALLOC_EXTENT)
+        return V6FS_EINVAL;
+
+    pthread_mutex_lock(&fs->lock);
+    setAllocMode(fs,mode);
+    endCall(fs);
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+int v6fs_set_dir_index(v6fs_t* fs,int on){
+    pthread_mutex_lock(&fs->lock);
+    fs->dir_index = on != 0;
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+int v6fs_set_free_mode(v6fs_t* fs,int mode){
+    int scrub = mode & ~V6FS_FREE_LAZY;
+    if(scrub != V6FS_FREE_PUNCH && scrub != V6FS_FREE_ZERO && scrub != V6FS_FREE_KEEP)
+        return V6FS_EINVAL;
+
+    pthread_mutex_lock(&fs->lock);
+    punchFlush(fs); //blocks already freed are scrubbed the way they were freed
+    fs->free_mode = scrub;
+    fs->lazy_free = (mode & V6FS_FREE_LAZY) != 0;
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+int v6fs_set_io_backend(v6fs_t* fs,int backend){
+    if(backend != V6FS_IO_SYNC && backend != V6FS_IO_URING)
+        return V6FS_EINVAL;
+
+    pthread_mutex_lock(&fs->lock);
+    if(backend == V6FS_IO_URING && fs->ring == NULL)
+        fs->ring = uringCreate();
+    if(backend == V6FS_IO_SYNC || fs->ring == NULL){
+        uringDestroy(fs->ring);
+        fs->ring = NULL;
+        backend = V6FS_IO_SYNC;
+    }
+    fs->io_backend = backend;
+    pthread_mutex_unlock(&fs->lock);
+    return backend;
+}
+
+int v6fs_set_log(v6fs_t* fs,int level,FILE* out){
+    if(level < V6FS_LOG_QUIET || level > V6FS_LOG_DEBUG)
+        return V6FS_EINVAL;
+
+    pthread_mutex_lock(&fs->lock);
+    fs->log_level = level;
+    fs->log_out = out;
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+int v6fs_set_journal(v6fs_t* fs,int num_blocks){
+    if(num_blocks != 0 && num_blocks < JOURNAL_MIN_BLOCKS)
+        return V6FS_EINVAL;
+
+    pthread_mutex_lock(&fs->lock);
+    fs->journal_format_blocks = num_blocks;
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+int v6fs_set_sync_interval(v6fs_t* fs,int interval){
+    if(interval < 0)
+        return V6FS_EINVAL;
+
+    pthread_mutex_lock(&fs->lock);
+    fs->superblock_sync_interval = interval;
+    fs->commands_since_sync = 0;
+    pthread_mutex_unlock(&fs->lock);
+    return V6FS_OK;
+}
+
+const char* v6fs_strerror(int err){
+    switch(err){
+        case V6FS_OK: return "Success";
+        case V6FS_ENOENT: return "No such file or directory";
+        case V6FS_EEXIST: return "File or directory already present";
+        case V6FS_ENAMETOOLONG: return "Length of file/directory should be less than or equal to 28 characters";
+        case V6FS_ENOSPC: return "No free data block available";
+        case V6FS_ENOINODE: return "No free inode to allocate";
+        case V6FS_ENOTDIR: return "Not a directory";
+        case V6FS_EDIRFULL: return "Directory is full";
+        case V6FS_EFBIG: return "File too large";
+        case V6FS_EIO: return "I/O error";
+        case V6FS_EINVAL: return "Invalid argument";
+        case V6FS_ENOTFORMATTED: return "File system not initialized, run initfs first";
+    }
+    return err >= 0 ? "Success" : "Unknown error";
+}
@@ -0,0 +1,226 @@
+#ifndef V6FS_H
+#define V6FS_H
+
+/*
+libv6fs - Unix V6 file system image library
+every image is accessed through a v6fs_t handle returned by v6fs_open(), so several images can be open in one process.
+All calls on a handle are serialized by a lock in the handle and may be made from multiple threads.
+Calls return V6FS_OK (0) or a positive value on success and one of the negative V6FS_E* codes on failure
+*/
+
+#include <stdio.h>
+
+typedef struct v6fs v6fs_t;
+
+//error codes
+#define V6FS_OK 0
+#define V6FS_ENOENT -1        //path or file not found
+#define V6FS_EEXIST -2        //name already present in the directory
+#define V6FS_ENAMETOOLONG -3  //file/dir names are limited to 28 characters
+#define V6FS_ENOSPC -4        //no free data block
+#define V6FS_ENOINODE -5      //no free inode
+#define V6FS_ENOTDIR -6       //a path component is not a directory
+#define V6FS_EDIRFULL -7      //no room left in the directory
+#define V6FS_EFBIG -8         //file larger than the block map can address
+#define V6FS_EIO -9           //opening or accessing the image or an external file failed
+#define V6FS_EINVAL -10       //invalid argument
+#define V6FS_ENOTFORMATTED -11 //the image has no file system yet, v6fs_format() it first
+
+//largest image v6fs_format() accepts, in blocks. Block numbers are ints, this keeps their sums in range
+#define V6FS_MAX_BLOCKS (1<<30)
+
+//flags for v6fs_open()
+#define V6FS_MMAP 1 //access the image through a shared mapping instead of the block cache
+
+//block allocation modes for v6fs_set_alloc_mode()
+#define V6FS_ALLOC_LIST 0   //the V6 free chain
+#define V6FS_ALLOC_EXTENT 1 //contiguous runs from an in-memory free block bitmap
+
+//what becomes of the blocks of removed files, for v6fs_set_free_mode()
+#define V6FS_FREE_PUNCH 0 //holes are punched into the image over the freed runs, zeros are written where that fails
+#define V6FS_FREE_ZERO 1  //the freed runs are overwritten with zeros
+#define V6FS_FREE_KEEP 2  //the old contents are left in place
+#define V6FS_FREE_LAZY 4  //or'ed with the above, rm only queues the blocks and they are freed at the sync points
+
+//I/O backends for v6fs_set_io_backend()
+#define V6FS_IO_SYNC 0  //pread/pwrite and in-kernel copies
+#define V6FS_IO_URING 1 //batches of reads and writes submitted through io_uring
+
+//log levels for v6fs_set_log()
+#define V6FS_LOG_QUIET 0 //nothing
+#define V6FS_LOG_INFO 1  //fallbacks and other unusual events
+#define V6FS_LOG_DEBUG 2 //every block and inode allocated or freed
+
+//operations timed by the latency histograms of v6fs_stats_t
+#define V6FS_OP_FORMAT 0
+#define V6FS_OP_MKDIR 1
+#define V6FS_OP_CPIN 2
+#define V6FS_OP_CPOUT 3
+#define V6FS_OP_CPIN_TREE 4
+#define V6FS_OP_CPOUT_TREE 5
+#define V6FS_OP_RM 6
+#define V6FS_OP_LOOKUP 7
+#define V6FS_OP_CHDIR 8
+#define V6FS_OP_SYNC 9
+#define V6FS_OP_FSCK 10
+#define V6FS_NUM_OPS 11
+
+//flags for v6fs_fsck()
+#define V6FS_FSCK_REPAIR 1 //fix what can be fixed and rebuild the free chain from the blocks found in use
+
+//bucket i of a latency histogram counts calls which took less than 2^i microseconds, the last one all longer calls
+#define V6FS_LATENCY_BUCKETS 32
+
+//counters kept by every handle since it was opened or the last v6fs_reset_stats()
+typedef struct {
+    //system calls on the image and the external files
+    long long reads;
+    long long read_bytes;
+    long long writes;
+    long long write_bytes;
+    long long seeks;
+    long long copies; //copy_file_range, sendfile and io_uring transfers
+    long long copy_bytes;
+    long long syncs;
+
+    long long cache_hits;
+    long long cache_misses;
+    long long inode_cache_hits;
+    long long inode_cache_misses;
+    long long blocks_allocated;
+    long long blocks_freed;
+    long long blocks_punched; //freed blocks whose contents were dropped by punching a hole into the image
+    long long blocks_sparse; //blocks of zeros cpin left unallocated
+    long long inodes_allocated;
+    long long inodes_freed;
+    long long inodes_scanned; //inodes examined while building or searching the free inode bitmap
+    long long dentry_hits; //path components resolved from the dentry cache
+    long long dentries_compared; //directory entries compared while resolving paths
+    long long journal_commits;
+    long long journal_blocks; //metadata blocks written to the journal
+
+    long long op_calls[V6FS_NUM_OPS];
+    long long op_usecs[V6FS_NUM_OPS];
+    long long op_latency[V6FS_NUM_OPS][V6FS_LATENCY_BUCKETS];
+} v6fs_stats_t;
+
+//summary of a v6fs_fsck() run
+typedef struct {
+    long long inodes; //allocated inodes
+    long long directories;
+    long long blocks_used; //data, indirect and directory blocks
+    long long blocks_free; //blocks on the free chain
+    long long problems;
+    long long repaired;
+} v6fs_fsck_t;
+
+//opens (creating if absent) the image at path. Returns NULL and sets *err on failure
+v6fs_t* v6fs_open(const char* path,int flags,int* err);
+
+//formats the image with total_blocks blocks, below V6FS_MAX_BLOCKS, of which inode_blocks hold inodes
+int v6fs_format(v6fs_t* fs,int total_blocks,int inode_blocks);
+
+//writes everything back and releases the handle
+int v6fs_close(v6fs_t* fs);
+
+//writes cached blocks and the superblock back to the image
+int v6fs_sync(v6fs_t* fs);
+
+int v6fs_mkdir(v6fs_t* fs,const char* path);
+
+//copies the external file ext_path into the image as path, V6FS_EEXIST when path is already taken
+int v6fs_cpin(v6fs_t* fs,const char* ext_path,const char* path);
+
+//copies the file at path out of the image into ext_path
+int v6fs_cpout(v6fs_t* fs,const char* path,const char* ext_path);
+
+/*
+recursively copies the external directory ext_dir into the directory path, which is created if absent.
+File contents are copied by num_threads worker threads (0 for one per online CPU). Entries that fail are
+skipped and the first error is returned once the rest of the tree is imported, a file whose name is already
+taken fails with V6FS_EEXIST. Each file appears in the image once its contents are copied. v6fs_format(),
+v6fs_close() and v6fs_fsck() called meanwhile wait for the copy to end
+*/
+int v6fs_cpin_tree(v6fs_t* fs,const char* ext_dir,const char* path,int num_threads);
+
+/*
+recursively copies the directory path out into the external directory ext_dir, created if absent. num_threads as for
+v6fs_cpin_tree(). v6fs_rm() of a file already listed waits until the file has been copied
+*/
+int v6fs_cpout_tree(v6fs_t* fs,const char* path,const char* ext_dir,int num_threads);
+
+int v6fs_rm(v6fs_t* fs,const char* path);
+
+//resolves path, relative paths start at the current directory. Returns the inode number
+int v6fs_lookup(v6fs_t* fs,const char* path);
+
+//changes the current directory of the handle. Returns the new current inode number
+int v6fs_chdir(v6fs_t* fs,const char* path);
+
+//number of blocks the block cache holds, at least 8. With a journal it holds more while the blocks changed since the
+//last commit don't fit
+int v6fs_set_cache_size(v6fs_t* fs,int num_blocks);
+
+//in V6FS_ALLOC_EXTENT the free chain on the image is only rewritten by v6fs_sync() and v6fs_close(), after a crash
+//v6fs_fsck() with V6FS_FSCK_REPAIR rebuilds it
+int v6fs_set_alloc_mode(v6fs_t* fs,int mode);
+
+//on 1, a directory that fills its blocks is converted to a hashed index so lookups and inserts read a few blocks
+//instead of all of them. Off (the default), directories are scanned linearly. Indexed directories stay indexed.
+//With a journal a directory is only converted when the transaction has room for all of its blocks
+int v6fs_set_dir_index(v6fs_t* fs,int on);
+
+/*
+sets what rm does with the blocks of the removed file, V6FS_FREE_PUNCH (the default), V6FS_FREE_ZERO or V6FS_FREE_KEEP.
+The freed blocks are scrubbed at the next sync point in contiguous runs, after the commit of the rm on a journaled image.
+With V6FS_FREE_LAZY rm returns without reading the block map of the file, the blocks are freed at the following sync
+points, at most a few thousand each, and all of them by v6fs_sync(), v6fs_close() and v6fs_fsck(). On a journaled image
+they only become free once the rm is committed, and a crash before they are leaves them neither used nor free until
+v6fs_fsck() with V6FS_FSCK_REPAIR
+*/
+int v6fs_set_free_mode(v6fs_t* fs,int mode);
+
+//selects the backend data blocks of cpin/cpout are moved with. Returns the backend in use, which is
+//V6FS_IO_SYNC when io_uring is not available
+int v6fs_set_io_backend(v6fs_t* fs,int backend);
+
+//messages up to level are written to out, one per line. The default is V6FS_LOG_QUIET on stderr
+int v6fs_set_log(v6fs_t* fs,int level,FILE* out);
+
+/*
+number of blocks the next v6fs_format() reserves at the end of the image for a metadata journal, 0 (the default) for
+none, raised to what two calls and a rewrite of the free chain take. On an image with a journal, metadata changes reach
+the image only through transactions committed to the journal with a single fdatasync, every sync interval calls (group
+commit), and committed transactions are replayed by v6fs_open() after a crash. A call is never split between two
+transactions, the transaction is committed earlier when the next call might not fit in it. Blocks freed by rm are
+only allocated again once the transaction freeing them is committed, which mkdir and cpin do first when some wait.
+Those the transaction has no room for wait for the next ones, and a crash before leaves them neither used nor free
+until v6fs_fsck() with V6FS_FSCK_REPAIR. The journal is not used while the image is mapped with V6FS_MMAP
+*/
+int v6fs_set_journal(v6fs_t* fs,int num_blocks);
+
+//the superblock is written after every interval calls, 0 writes it only on v6fs_sync() and v6fs_close().
+//With a journal this is the number of calls grouped into one transaction
+int v6fs_set_sync_interval(v6fs_t* fs,int interval);
+
+/*
+checks the consistency of the image: block ownership, directory entries and sizes, link counts and the free chain.
+The inode table is scanned by num_threads threads (as for v6fs_cpin_tree()), each problem is written as one line to
+out (NULL for none) and report, if not NULL, receives the totals. Returns the number of problems found
+*/
+int v6fs_fsck(v6fs_t* fs,int flags,int num_threads,FILE* out,v6fs_fsck_t* report);
+
+//copies the counters of the handle into stats
+int v6fs_get_stats(v6fs_t* fs,v6fs_stats_t* stats);
+
+int v6fs_reset_stats(v6fs_t* fs);
+
+//writes the counters as one JSON object
+int v6fs_write_stats_json(v6fs_t* fs,FILE* out);
+
+//name of a V6FS_OP_* operation, as used in the JSON keys
+const char* v6fs_op_name(int op);
+
+const char* v6fs_strerror(int err);
+
+#endif
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "v6fs.h"
+
+/*
+v6fs_bench - standard workloads against a freshly formatted image
+usage: v6fs_bench [-d work dir] [-s scale] [-m] [-a list|extent] [-u] [-i] [-f punch|zero|keep|lazy]
+    -d  directory the image and the external files are created in, /tmp by default
+    -s  multiplies the number of operations of every workload, 1 by default
+    -m  opens the image with V6FS_MMAP
+    -a  block allocation mode
+    -u  moves data blocks through io_uring
+    -i  gives full directories a hashed index
+    -f  what rm does with the freed blocks, lazy punches holes after freeing them in batches at the sync points
+
+every workload prints one line:
+    bench <name> ops=<n> secs=<s> ops_per_s=<n> mb_per_s=<n> syscalls_per_op=<n> peak_rss_kb=<n>
+syscalls are the reads, writes, seeks, copies and syncs counted by v6fs_get_stats(), mb_per_s is 0 for workloads
+moving no file data
+*/
+
+#define BENCH_BLOCKS 400000    //image of about 400 MB, sparse until written
+#define BENCH_INODE_BLOCKS 2000 //32000 inodes
+#define BENCH_DIR_FILES 250    //files per directory, within the 9 blocks of a small directory
+
+typedef struct {
+    double start;
+    long long syscalls;
+} bench_mark_type;
+
+v6fs_t* fs;
+char work_dir[200];
+
+double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+long long syscalls(){
+    v6fs_stats_t stats;
+    v6fs_get_stats(fs,&stats);
+    return stats.reads + stats.writes + stats.seeks + stats.copies + stats.syncs;
+}
+
+void benchStart(bench_mark_type* mark){
+    mark->syscalls = syscalls();
+    mark->start = now();
+}
+
+void benchReport(bench_mark_type* mark,const char* name,long long ops,long long bytes){
+    double secs = now() - mark->start;
+    long long calls = syscalls() - mark->syscalls;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+
+    if(secs <= 0)
+        secs = 1e-9;
+    printf("bench %s ops=%lld secs=%.6f ops_per_s=%.1f mb_per_s=%.1f syscalls_per_op=%.2f peak_rss_kb=%ld\n",
+        name,ops,secs,ops/secs,bytes/secs/(1024*1024),ops > 0 ? (double)calls/ops : 0.0,usage.ru_maxrss);
+    fflush(stdout);
+}
+
+//aborting on the first failing call, a benchmark of a failing workload measures nothing
+void check(int status,const char* what){
+    if(status < 0){
+        fprintf(stderr,"%s: %s\n",what,v6fs_strerror(status));
+        exit(1);
+    }
+}
+
+//writing size bytes of a repeating pattern to an external file
+void makeExtFile(char* path,long long size){
+    int fd = open(path,O_CREAT | O_WRONLY | O_TRUNC,0644);
+    if(fd == -1){
+        fprintf(stderr,"Cannot create %s\n",path);
+        exit(1);
+    }
+    char buf[65536];
+    int i;
+    for(i=0;i<(int)sizeof(buf);i++)
+        buf[i] = 'a' + i%26;
+    while(size > 0){
+        int n = size < (long long)sizeof(buf) ? size : (long long)sizeof(buf);
+        if(write(fd,buf,n) != n)
+            break;
+        size = size - n;
+    }
+    close(fd);
+}
+
+//N entries in one directory, the lookup of each new name scans every entry before it
+void benchMkdirFlat(){
+    bench_mark_type mark;
+    char path[256];
+    int n = BENCH_DIR_FILES;
+    int i;
+
+    check(v6fs_mkdir(fs,"/flat"),"mkdir /flat");
+    benchStart(&mark);
+    for(i=0;i<n;i++){
+        snprintf(path,sizeof(path),"/flat/d%d",i);
+        check(v6fs_mkdir(fs,path),path);
+    }
+    benchReport(&mark,"mkdir_flat",n,0);
+}
+
+//one directory of many blocks, the duplicate check and the search for a free entry of each new name read the directory
+void benchWide(int scale){
+    bench_mark_type mark;
+    char path[256];
+    int n = 2000*scale;
+    int i;
+
+    check(v6fs_mkdir(fs,"/wide"),"mkdir /wide");
+    benchStart(&mark);
+    for(i=0;i<n;i++){
+        snprintf(path,sizeof(path),"/wide/d%d",i);
+        check(v6fs_mkdir(fs,path),path);
+    }
+    benchReport(&mark,"mkdir_wide",n,0);
+}
+
+//a chain of directories each created inside the previous one, 120 levels is what a 256 byte path can name
+void benchMkdirDeep(){
+    bench_mark_type mark;
+    int depth = 120;
+    int i;
+
+    check(v6fs_mkdir(fs,"/deep"),"mkdir /deep");
+    check(v6fs_chdir(fs,"/deep"),"cd /deep");
+    benchStart(&mark);
+    for(i=0;i<depth;i++){
+        check(v6fs_mkdir(fs,"d"),"mkdir d");
+        check(v6fs_chdir(fs,"d"),"cd d");
+    }
+    benchReport(&mark,"mkdir_deep",2*depth,0);
+    check(v6fs_chdir(fs,"/"),"cd /");
+}
+
+//resolving absolute paths of depth levels inside the deep chain
+void benchLookup(int scale,int depth){
+    bench_mark_type mark;
+    char path[256] = "/deep";
+    int n = 20000*scale;
+    int i;
+
+    for(i=0;i<depth;i++)
+        strcat(path,"/d");
+
+    char name[64];
+    snprintf(name,sizeof(name),"lookup_depth%d",depth);
+    benchStart(&mark);
+    for(i=0;i<n;i++)
+        check(v6fs_lookup(fs,path),path);
+    benchReport(&mark,name,n,0);
+}
+
+//many 4 KB files spread over directories of BENCH_DIR_FILES files
+void benchCpinSmall(int scale){
+    bench_mark_type mark;
+    char ext[256];
+    char path[256];
+    int n = 2000*scale;
+    int size = 4096;
+    int i;
+
+    snprintf(ext,sizeof(ext),"%s/v6fs_bench_small",work_dir);
+    makeExtFile(ext,size);
+    check(v6fs_mkdir(fs,"/small"),"mkdir /small");
+
+    benchStart(&mark);
+    for(i=0;i<n;i++){
+        if(i%BENCH_DIR_FILES == 0){
+            snprintf(path,sizeof(path),"/small/s%d",i/BENCH_DIR_FILES);
+            check(v6fs_mkdir(fs,path),path);
+        }
+        snprintf(path,sizeof(path),"/small/s%d/f%d",i/BENCH_DIR_FILES,i%BENCH_DIR_FILES);
+        check(v6fs_cpin(fs,ext,path),path);
+    }
+    benchReport(&mark,"cpin_small",n,(long long)n*size);
+    unlink(ext);
+}
+
+//one large file copied in and out again
+void benchLarge(int scale){
+    bench_mark_type mark;
+    char ext[256];
+    char out[256];
+    long long size = 64LL*1024*1024*scale;
+
+    snprintf(ext,sizeof(ext),"%s/v6fs_bench_large",work_dir);
+    snprintf(out,sizeof(out),"%s/v6fs_bench_large.out",work_dir);
+    makeExtFile(ext,size);
+
+    benchStart(&mark);
+    check(v6fs_cpin(fs,ext,"/large"),"cpin /large");
+    check(v6fs_sync(fs),"sync");
+    benchReport(&mark,"cpin_large",1,size);
+
+    benchStart(&mark);
+    check(v6fs_cpout(fs,"/large",out),"cpout /large");
+    benchReport(&mark,"cpout_large",1,size);
+
+    benchStart(&mark);
+    check(v6fs_rm(fs,"/large"),"rm /large");
+    check(v6fs_sync(fs),"sync");
+    benchReport(&mark,"rm_large",1,0);
+    unlink(ext);
+    unlink(out);
+}
+
+//creating and removing files in one directory, so blocks and inodes keep being freed and reused
+void benchRmChurn(int scale){
+    bench_mark_type mark;
+    char ext[256];
+    char path[256];
+    int rounds = 20*scale;
+    int size = 16384;
+    int r;
+    int i;
+
+    snprintf(ext,sizeof(ext),"%s/v6fs_bench_churn",work_dir);
+    makeExtFile(ext,size);
+    check(v6fs_mkdir(fs,"/churn"),"mkdir /churn");
+
+    benchStart(&mark);
+    for(r=0;r<rounds;r++){
+        for(i=0;i<100;i++){
+            snprintf(path,sizeof(path),"/churn/f%d",i);
+            check(v6fs_cpin(fs,ext,path),path);
+        }
+        for(i=0;i<100;i++){
+            snprintf(path,sizeof(path),"/churn/f%d",i);
+            check(v6fs_rm(fs,path),path);
+        }
+    }
+    benchReport(&mark,"rm_churn",(long long)rounds*200,(long long)rounds*100*size);
+    unlink(ext);
+}
+
+int main(int argc,char* argv[]){
+    int scale = 1;
+    int flags = 0;
+    int alloc_mode = V6FS_ALLOC_LIST;
+    int uring = 0;
+    int dir_index = 0;
+    int free_mode = V6FS_FREE_PUNCH;
+    strcpy(work_dir,"/tmp");
+
+    int i;
+    for(i=1;i<argc;i++){
+        if(strcmp(argv[i],"-d") == 0 && i+1 < argc && strlen(argv[i+1]) < 150){
+            strcpy(work_dir,argv[++i]);
+        }else if(strcmp(argv[i],"-s") == 0 && i+1 < argc && atoi(argv[i+1]) > 0){
+            scale = atoi(argv[++i]);
+        }else if(strcmp(argv[i],"-m") == 0){
+            flags = V6FS_MMAP;
+        }else if(strcmp(argv[i],"-a") == 0 && i+1 < argc){
+            alloc_mode = strcmp(argv[++i],"extent") == 0 ? V6FS_ALLOC_EXTENT : V6FS_ALLOC_LIST;
+        }else if(strcmp(argv[i],"-u") == 0){
+            uring = 1;
+        }else if(strcmp(argv[i],"-i") == 0){
+            dir_index = 1;
+        }else if(strcmp(argv[i],"-f") == 0 && i+1 < argc){
+            i++;
+            if(strcmp(argv[i],"zero") == 0)
+                free_mode = V6FS_FREE_ZERO;
+            else if(strcmp(argv[i],"keep") == 0)
+                free_mode = V6FS_FREE_KEEP;
+            else if(strcmp(argv[i],"lazy") == 0)
+                free_mode = V6FS_FREE_PUNCH | V6FS_FREE_LAZY;
+        }else{
+            fprintf(stderr,"Usage: %s [-d work dir] [-s scale] [-m] [-a list|extent] [-u] [-i] [-f punch|zero|keep|lazy]\n",
+                argv[0]);
+            return 1;
+        }
+    }
+
+    char image[256];
+    snprintf(image,sizeof(image),"%s/v6fs_bench.img",work_dir);
+    unlink(image);
+
+    int err;
+    fs = v6fs_open(image,flags,&err);
+    if(fs == NULL){
+        fprintf(stderr,"Cannot open %s: %s\n",image,v6fs_strerror(err));
+        return 1;
+    }
+    v6fs_set_alloc_mode(fs,alloc_mode);
+    if(uring)
+        v6fs_set_io_backend(fs,V6FS_IO_URING);
+    v6fs_set_dir_index(fs,dir_index);
+    v6fs_set_free_mode(fs,free_mode);
+
+    bench_mark_type mark;
+    benchStart(&mark);
+    check(v6fs_format(fs,BENCH_BLOCKS,BENCH_INODE_BLOCKS),"initfs");
+    benchReport(&mark,"initfs",1,0);
+
+    benchMkdirFlat();
+    benchWide(scale);
+    benchMkdirDeep();
+    benchLookup(scale,1);
+    benchLookup(scale,8);
+    benchLookup(scale,32);
+    benchLookup(scale,120);
+    benchCpinSmall(scale);
+    benchLarge(scale);
+    benchRmChurn(scale);
+
+    v6fs_close(fs);
+    unlink(image);
+    return 0;
+}
@@ -0,0 +1,586 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "v6fs_internal.h"
+
+/*
+Bulk import and export of directory trees
+the calling thread walks the tree once and does everything that touches file system metadata under the handle lock:
+creating directories and files, allocating or looking up the data blocks of each file. Data blocks are not held in
+the block cache, so the file contents are then copied by a pool of worker threads straight between the external
+files and the block runs in the image without taking the lock, overlapping with the walk.
+An imported file is named in its directory only by the worker finishing its copy, so no commit makes a file reachable
+before its data is in the image, a crash in between leaves an orphan which fsck REPAIR frees. The entries of a directory
+being exported are pinned when they are listed and rm waits until each has been copied. format, close and fsck wait
+for the bulk calls running to end
+*/
+
+//blocks copied by one job, a large file is split into several jobs so it is copied by several workers
+#define BULK_CHUNK_BLOCKS 8192
+
+//an external file being copied, released by the worker finishing its last job
+typedef struct {
+    int fde;
+    int export; //1 to copy from the image to fde, 0 from fde into the image
+    long long size;
+    block_run_type* runs;
+    int num_runs;
+    int jobs_left;
+    int status; //first error met copying the file
+    int iNumber; //imported file, named name in the directory parent once its data is written
+    int parent;
+    char name[29];
+} bulk_file_type;
+
+typedef struct bulk_job {
+    bulk_file_type* file;
+    int lbn_start; //blocks lbn_start to lbn_end-1 of the file
+    int lbn_end;
+    struct bulk_job* next;
+} bulk_job_type;
+
+typedef struct {
+    v6fs_t* fs;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    bulk_job_type* head;
+    bulk_job_type* tail;
+    int queued;
+    int max_queued;
+    int done; //set once the walk has queued its last job
+    int status; //first error met while copying
+    int io_uring; //each worker copies through its own ring
+    pthread_t* workers;
+    int num_workers;
+} bulk_queue_type;
+
+void bulkError(bulk_queue_type* queue,int status){
+    pthread_mutex_lock(&queue->lock);
+    if(queue->status == V6FS_OK)
+        queue->status = status;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+//copies blocks lbn_start to lbn_end-1 of a file in the image out to the external file, in the kernel where possible
+int exportCopy(v6fs_t* fs,bulk_file_type* file,int lbn_start,int lbn_end,uring_type* ring){
+    int i;
+    for(i=0;i<file->num_runs;i++){
+        block_run_type* run = &file->runs[i];
+        int first = run->lbn > lbn_start ? run->lbn : lbn_start;
+        int last = run->lbn + run->len < lbn_end ? run->lbn + run->len : lbn_end;
+        if(first >= last)
+            continue;
+
+        long long len = (long long)(last - first)*BLOCKSIZE;
+        if((long long)first*BLOCKSIZE + len > file->size)
+            len = file->size - (long long)first*BLOCKSIZE;
+        if(copyImageRange(fs,file->fde,(off_t)BLOCKSIZE*(run->bNumber + first - run->lbn),(off_t)BLOCKSIZE*first,len,ring) < 0)
+            return V6FS_EIO;
+    }
+    return V6FS_OK;
+}
+
+//pins of the inodes listed by exports, called with the lock held
+void pinInode(v6fs_t* fs,int iNumber){
+    if(fs->num_pinned == fs->pinned_capacity){
+        fs->pinned_capacity = fs->pinned_capacity > 0 ? fs->pinned_capacity*2 : 64;
+        fs->pinned = realloc(fs->pinned,sizeof(int) * fs->pinned_capacity);
+    }
+    fs->pinned[fs->num_pinned++] = iNumber;
+}
+
+void unpinInode(v6fs_t* fs,int iNumber){
+    int i;
+    for(i=0;i<fs->num_pinned;i++){
+        if(fs->pinned[i] == iNumber){
+            fs->pinned[i] = fs->pinned[--fs->num_pinned];
+            pthread_cond_broadcast(&fs->bulk_done);
+            return;
+        }
+    }
+}
+
+int inodePinned(v6fs_t* fs,int iNumber){
+    int i;
+    for(i=0;i<fs->num_pinned;i++){
+        if(fs->pinned[i] == iNumber)
+            return 1;
+    }
+    return 0;
+}
+
+//releasing a file whose jobs are all done, an imported file is named in its directory now or freed if its copy failed
+//and an exported one is unpinned
+void bulkRelease(bulk_queue_type* queue,bulk_file_type* file){
+    if(close(file->fde) == -1)
+        bulkError(queue,V6FS_EIO);
+
+    int status = file->status;
+    v6fs_t* fs = queue->fs;
+    if(file->export){
+        pthread_mutex_lock(&fs->lock);
+        unpinInode(fs,file->iNumber);
+        pthread_mutex_unlock(&fs->lock);
+    }else{
+        pthread_mutex_lock(&fs->lock);
+        journalReserve(fs,JOURNAL_CALL_BLOCKS);
+        if(status == V6FS_OK)
+            status = linkFile(fs,file->name,file->parent,file->iNumber);
+        if(status < 0){
+            inode_type inode;
+            readInodeFromFS(fs,file->iNumber,&inode);
+            removeFile(fs,file->iNumber,&inode);
+        }else if(journaling(fs)){
+            fs->journal_unsynced = 1; //the data reaches the disk before the commit naming the file
+        }
+        pthread_mutex_unlock(&fs->lock);
+    }
+
+    if(status < 0)
+        bulkError(queue,status);
+    free(file->runs);
+    free(file);
+}
+
+void* bulkWorker(void* arg){
+    bulk_queue_type* queue = arg;
+    uring_type* ring = queue->io_uring ? uringCreate() : NULL;
+    char* buf = ring == NULL ? malloc(STREAM_BUFSIZE) : NULL;
+
+    while(1){
+        pthread_mutex_lock(&queue->lock);
+        while(queue->head == NULL && queue->done == 0)
+            pthread_cond_wait(&queue->not_empty,&queue->lock);
+        bulk_job_type* job = queue->head;
+        if(job == NULL){
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        queue->head = job->next;
+        if(queue->head == NULL)
+            queue->tail = NULL;
+        queue->queued--;
+        pthread_cond_signal(&queue->not_full);
+        pthread_mutex_unlock(&queue->lock);
+
+        bulk_file_type* file = job->file;
+        int status;
+        if(file->export)
+            status = exportCopy(queue->fs,file,job->lbn_start,job->lbn_end,ring);
+        else
+            status = copyRunsIn(queue->fs,file->fde,file->size,file->runs,file->num_runs,job->lbn_start,job->lbn_end,ring,buf);
+
+        pthread_mutex_lock(&queue->lock);
+        if(status < 0 && file->status == V6FS_OK)
+            file->status = status;
+        int last_job = --file->jobs_left == 0;
+        pthread_mutex_unlock(&queue->lock);
+        if(last_job)
+            bulkRelease(queue,file);
+        free(job);
+    }
+
+    free(buf);
+    uringDestroy(ring);
+    return NULL;
+}
+
+//ending a bulk call counted in bulk_calls, called with the lock held
+void bulkLeave(v6fs_t* fs){
+    fs->bulk_calls--;
+    pthread_cond_broadcast(&fs->bulk_done);
+}
+
+//waiting with the lock released until no bulk call is running, for the calls replacing or checking the whole image
+void bulkWait(v6fs_t* fs){
+    while(fs->bulk_calls > 0)
+        pthread_cond_wait(&fs->bulk_done,&fs->lock);
+}
+
+void bulkStart(bulk_queue_type* queue,v6fs_t* fs,int num_threads){
+    if(num_threads <= 0)
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(num_threads <= 0)
+        num_threads = 1;
+
+    memset(queue,0,sizeof(bulk_queue_type));
+    queue->fs = fs;
+    queue->max_queued = 4*num_threads;
+    pthread_mutex_lock(&fs->lock);
+    queue->io_uring = fs->io_backend == V6FS_IO_URING;
+    pthread_mutex_unlock(&fs->lock);
+    pthread_mutex_init(&queue->lock,NULL);
+    pthread_cond_init(&queue->not_empty,NULL);
+    pthread_cond_init(&queue->not_full,NULL);
+
+    queue->workers = malloc(sizeof(pthread_t) * num_threads);
+    queue->num_workers = num_threads;
+    int i;
+    for(i=0;i<num_threads;i++)
+        pthread_create(&queue->workers[i],NULL,bulkWorker,queue);
+}
+
+//waiting for the workers to copy everything queued, returns the first error met
+int bulkFinish(bulk_queue_type* queue){
+    pthread_mutex_lock(&queue->lock);
+    queue->done = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    int i;
+    for(i=0;i<queue->num_workers;i++)
+        pthread_join(queue->workers[i],NULL);
+    free(queue->workers);
+
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+
+    v6fs_t* fs = queue->fs;
+    pthread_mutex_lock(&fs->lock);
+    endCall(fs);
+    bulkLeave(fs);
+    pthread_mutex_unlock(&fs->lock);
+
+    return queue->status;
+}
+
+//queuing the jobs copying a file, waiting while the queue is full. A file with no blocks is released here
+void bulkQueueFile(bulk_queue_type* queue,bulk_file_type* file){
+    int num_blocks = (file->size + BLOCKSIZE - 1)/BLOCKSIZE;
+    file->jobs_left = (num_blocks + BULK_CHUNK_BLOCKS - 1)/BULK_CHUNK_BLOCKS;
+    file->status = V6FS_OK;
+
+    if(file->num_runs == 0){
+        bulkRelease(queue,file);
+        return;
+    }
+
+    int lbn;
+    for(lbn=0;lbn<num_blocks;lbn=lbn+BULK_CHUNK_BLOCKS){
+        bulk_job_type* job = malloc(sizeof(bulk_job_type));
+        job->file = file;
+        job->lbn_start = lbn;
+        job->lbn_end = lbn + BULK_CHUNK_BLOCKS < num_blocks ? lbn + BULK_CHUNK_BLOCKS : num_blocks;
+        job->next = NULL;
+
+        pthread_mutex_lock(&queue->lock);
+        while(queue->queued >= queue->max_queued)
+            pthread_cond_wait(&queue->not_full,&queue->lock);
+        if(queue->tail != NULL)
+            queue->tail->next = job;
+        else
+            queue->head = job;
+        queue->tail = job;
+        queue->queued++;
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+int isDirectory(v6fs_t* fs,int iNumber){
+    icache_entry_type* inode = inodeGet(fs,iNumber);
+    int type = inode->flags & (3<<13);
+    inodePut(fs,inode);
+    return type == (2<<13);
+}
+
+//creating the file name in directory parent with its blocks allocated and queuing the copy of extFile into it, the
+//file is named by bulkRelease(). V6FS_EEXIST when parent already has an entry name
+int importFile(bulk_queue_type* queue,char* extFile,char* name,int parent){
+    v6fs_t* fs = queue->fs;
+    if(strlen(name) > 28)
+        return V6FS_ENAMETOOLONG;
+
+    int fde = open(extFile,O_RDONLY);
+    if(fde == -1)
+        return V6FS_EIO;
+    struct stat st;
+    fstat(fde,&st);
+
+    //the external file is scanned for blocks of zeros before the lock is taken
+    unsigned long long* data_map;
+    int status = fileDataMap(fs,fde,&st,&data_map);
+    if(status < 0){
+        close(fde);
+        return status;
+    }
+
+    bulk_file_type* file = malloc(sizeof(bulk_file_type));
+    file->fde = fde;
+    file->export = 0;
+    file->size = st.st_size;
+    file->runs = NULL;
+    file->parent = parent;
+    strcpy(file->name,name);
+
+    pthread_mutex_lock(&fs->lock);
+    journalReserve(fs,JOURNAL_CALL_BLOCKS); //every file goes into the journal as if created by a call of its own
+    //a name already in the directory is not copied, bulkRelease() checks it again when linking
+    file->iNumber = nameExists(fs,parent,name) ? V6FS_EEXIST : newFileInode(fs,st.st_size);
+    file->num_runs = file->iNumber < 0 ? file->iNumber : fileRuns(fs,file->iNumber,1,data_map,0,INT_MAX,&file->runs);
+    if(file->num_runs < 0 && file->iNumber >= 0){
+        inode_type inode;
+        readInodeFromFS(fs,file->iNumber,&inode);
+        removeFile(fs,file->iNumber,&inode);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    free(data_map);
+
+    if(file->num_runs < 0){
+        status = file->num_runs;
+        close(fde);
+        free(file);
+        return status;
+    }
+
+    bulkQueueFile(queue,file);
+    return V6FS_OK;
+}
+
+//returns the inode of directory name in parent, creating it if it is not there
+int importDirectory(v6fs_t* fs,char* name,int parent){
+    pthread_mutex_lock(&fs->lock);
+    journalReserve(fs,JOURNAL_CALL_BLOCKS);
+    int status = makedir(fs,name,parent);
+    if(status >= 0 || status == V6FS_EEXIST){
+        status = path_to_inode(fs,name,parent);
+        if(status == -1)
+            status = V6FS_ENOENT;
+        else if(isDirectory(fs,status) == 0)
+            status = V6FS_ENOTDIR;
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return status;
+}
+
+/*
+importTree() - imports every directory and regular file below extDir into the directory parent
+description: symbolic links and special files are skipped. An entry which fails records the first error and the
+            walk goes on with the rest of the tree
+*/
+void importTree(bulk_queue_type* queue,char* extDir,int parent){
+    DIR* dir = opendir(extDir);
+    if(dir == NULL){
+        bulkError(queue,V6FS_EIO);
+        return;
+    }
+
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL){
+        if(strcmp(entry->d_name,".") == 0 || strcmp(entry->d_name,"..") == 0)
+            continue;
+
+        char path[PATH_MAX];
+        if(snprintf(path,sizeof(path),"%s/%s",extDir,entry->d_name) >= (int)sizeof(path)){
+            bulkError(queue,V6FS_ENAMETOOLONG);
+            continue;
+        }
+
+        struct stat st;
+        if(lstat(path,&st) == -1){
+            bulkError(queue,V6FS_EIO);
+            continue;
+        }
+
+        int status = V6FS_OK;
+        if(S_ISDIR(st.st_mode)){
+            int child = importDirectory(queue->fs,entry->d_name,parent);
+            if(child < 0)
+                status = child;
+            else
+                importTree(queue,path,child);
+        }else if(S_ISREG(st.st_mode)){
+            status = importFile(queue,path,entry->d_name,parent);
+        }
+
+        if(status < 0)
+            bulkError(queue,status);
+    }
+    closedir(dir);
+}
+
+/*
+v6fs_cpin_tree() - recursive cpin of the external directory ext_dir into the directory path, created if absent
+*/
+int v6fs_cpin_tree(v6fs_t* fs,const char* ext_dir,const char* path,int num_threads){
+    char buf[256];
+    char last_dir[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+    if(ext_dir == NULL)
+        return V6FS_EINVAL;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    fs->bulk_calls++; //from the lookup on, so a format can't replace the target
+    int target = V6FS_ENOTFORMATTED;
+    last_dir[0] = '\0';
+    if(fs->superBlock.fsize > 0){
+        target = path_to_inode(fs,buf,-1);
+        if(target == -1){
+            //the target directory is created below when its parent exists
+            target = process_path(fs,buf,last_dir);
+            if(target == -1)
+                target = V6FS_ENOENT;
+        }else if(isDirectory(fs,target) == 0){
+            target = V6FS_ENOTDIR;
+        }
+    }
+    pthread_mutex_unlock(&fs->lock);
+
+    if(target >= 0 && last_dir[0] != '\0')
+        target = importDirectory(fs,last_dir,target);
+    if(target < 0){
+        pthread_mutex_lock(&fs->lock);
+        bulkLeave(fs);
+        pthread_mutex_unlock(&fs->lock);
+        return target;
+    }
+
+    bulk_queue_type queue;
+    bulkStart(&queue,fs,num_threads);
+    importTree(&queue,(char*)ext_dir,target);
+    status = bulkFinish(&queue);
+    statsRecord(fs,V6FS_OP_CPIN_TREE,start);
+    return status;
+}
+
+//opening extFile for the pinned file iNumber and queuing the copy of its blocks, holes are left unwritten. Once the
+//file is queued its pin is dropped by bulkRelease()
+int exportFile(bulk_queue_type* queue,int iNumber,char* extFile){
+    v6fs_t* fs = queue->fs;
+
+    int fde = open(extFile,O_CREAT | O_WRONLY | O_TRUNC,0644);
+    if(fde == -1)
+        return V6FS_EIO;
+
+    bulk_file_type* file = malloc(sizeof(bulk_file_type));
+    file->fde = fde;
+    file->export = 1;
+    file->runs = NULL;
+    file->iNumber = iNumber;
+
+    pthread_mutex_lock(&fs->lock);
+    inode_type inode;
+    readInodeFromFS(fs,iNumber,&inode);
+    file->size = getFileSize(&inode);
+    file->num_runs = fileRuns(fs,iNumber,0,NULL,0,INT_MAX,&file->runs);
+    pthread_mutex_unlock(&fs->lock);
+
+    if(file->num_runs < 0 || ftruncate(fde,file->size) == -1){
+        int status = file->num_runs < 0 ? file->num_runs : V6FS_EIO;
+        close(fde);
+        free(file->runs);
+        free(file);
+        return status;
+    }
+
+    bulkQueueFile(queue,file);
+    return V6FS_OK;
+}
+
+/*
+exportTree() - exports every directory and plain file below the directory iNumber into extDir, which exists
+description: the entries of a directory are copied out of its blocks by dirEntries() and pinned under the lock, then each
+            one is handled with the lock released between entries. A file stays pinned until its copy is done
+*/
+void exportTree(bulk_queue_type* queue,int iNumber,char* extDir){
+    v6fs_t* fs = queue->fs;
+    dir_type* entries;
+
+    pthread_mutex_lock(&fs->lock);
+    int num_entries = dirEntries(fs,iNumber,&entries);
+    int i;
+    for(i=0;i<num_entries;i++)
+        pinInode(fs,entries[i].inode);
+    pthread_mutex_unlock(&fs->lock);
+
+    for(i=0;i<num_entries;i++){
+        char name[29];
+        memcpy(name,entries[i].filename,28);
+        name[28] = '\0';
+
+        pthread_mutex_lock(&fs->lock);
+        icache_entry_type* inode = inodeGet(fs,entries[i].inode);
+        int type = inode->flags & (3<<13);
+        inodePut(fs,inode);
+        pthread_mutex_unlock(&fs->lock);
+
+        char path[PATH_MAX];
+        int status = V6FS_OK;
+        if(snprintf(path,sizeof(path),"%s/%s",extDir,name) >= (int)sizeof(path)){
+            status = V6FS_ENAMETOOLONG;
+        }else if(type == 0){
+            status = exportFile(queue,entries[i].inode,path);
+            if(status == V6FS_OK)
+                continue; //unpinned once copied
+        }else if(type == (2<<13)){
+            if(mkdir(path,0755) == -1 && errno != EEXIST)
+                status = V6FS_EIO;
+            else
+                exportTree(queue,entries[i].inode,path);
+        }
+
+        if(status < 0)
+            bulkError(queue,status);
+        pthread_mutex_lock(&fs->lock);
+        unpinInode(fs,entries[i].inode);
+        pthread_mutex_unlock(&fs->lock);
+    }
+    free(entries);
+}
+
+/*
+v6fs_cpout_tree() - recursive cpout of the directory path into the external directory ext_dir, created if absent
+*/
+int v6fs_cpout_tree(v6fs_t* fs,const char* path,const char* ext_dir,int num_threads){
+    char buf[256];
+    int status = copyPath(buf,path);
+    if(status < 0)
+        return status;
+    if(ext_dir == NULL)
+        return V6FS_EINVAL;
+
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    fs->bulk_calls++;
+    int source = V6FS_ENOTFORMATTED;
+    if(fs->superBlock.fsize > 0){
+        source = path_to_inode(fs,buf,-1);
+        if(source == -1)
+            source = V6FS_ENOENT;
+        else if(isDirectory(fs,source) == 0)
+            source = V6FS_ENOTDIR;
+    }
+    if(source < 0)
+        bulkLeave(fs);
+    pthread_mutex_unlock(&fs->lock);
+
+    if(source < 0)
+        return source;
+    if(mkdir(ext_dir,0755) == -1 && errno != EEXIST){
+        pthread_mutex_lock(&fs->lock);
+        bulkLeave(fs);
+        pthread_mutex_unlock(&fs->lock);
+        return V6FS_EIO;
+    }
+
+    bulk_queue_type queue;
+    bulkStart(&queue,fs,num_threads);
+    exportTree(&queue,source,(char*)ext_dir);
+    status = bulkFinish(&queue);
+    statsRecord(fs,V6FS_OP_CPOUT_TREE,start);
+    return status;
+}
@@ -0,0 +1,836 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "v6fs_internal.h"
+
+/*
+Consistency checker
+the cached state is synced first, then the image is read with pread, bypassing the block cache. Worker threads take
+chunks of the inode table in turn and claim the blocks of every allocated inode in a shared bitmap, so a block found
+twice or outside the data blocks is noticed on the way. The directories found are checked in a second parallel pass,
+once the type of every inode is known, counting the names of each inode. The free chain is walked against the same
+bitmap and the link counts and .. entries are compared last.
+
+Repairs are collected as patches of the image while checking and applied through the block cache at the end: bad
+pointers and directory entries are cleared, sizes, link counts, . and .. are set, files in no directory are freed and
+the free chain is rebuilt from the blocks left unclaimed, a damaged directory index is dropped so the directory is
+scanned linearly again, and of the entries sharing a name in one directory only the first is kept. Blocks used twice and directories in no directory or in several are only reported
+*/
+
+#define FSCK_CHUNK_BLOCKS 64 //inode table blocks read by one pread, 1024 inodes
+
+//inode types recorded by the scan
+#define FSCK_FREE 0
+#define FSCK_FILE 1
+#define FSCK_DIR 2
+
+//a repair, len bytes written at byte address addr of the image
+typedef struct {
+    long long addr;
+    int len;
+    char data[32];
+} fsck_patch_type;
+
+//a directory found by the inode scan, its entries are checked once every inode has been scanned
+typedef struct {
+    int iNumber;
+    inode_type inode;
+} fsck_dir_type;
+
+typedef struct {
+    v6fs_t* fs;
+    int repair;
+    int releasing; //set while the blocks of a freed inode are given back, nothing is reported then
+    FILE* out;
+    pthread_mutex_t lock; //held while writing to out or adding a patch
+
+    int data_start;
+    int data_end; //first block after the data blocks, the journal region may follow
+    int num_inodes;
+    int num_chunks;
+    int next_chunk; //next chunk of the inode table to scan, taken atomically by the workers
+
+    //per inode state, indexed by inode number
+    unsigned char* kind;
+    unsigned short* nlinks;
+    unsigned int* refs; //named directory entries referring to the inode
+    unsigned int* parent; //directory holding one of those entries
+    unsigned int* dotdot; //.. entry of a directory
+    unsigned int* first_block; //logical block 0 of a directory, holding . and ..
+
+    unsigned long long* used; //blocks claimed by inodes
+    unsigned long long* shared; //blocks claimed more than once
+    unsigned long long* free_map; //blocks on the free chain
+    int free_chain_bad;
+
+    fsck_patch_type* patches;
+    int num_patches;
+    int max_patches;
+    int* orphans; //files in no directory, freed by the repair
+    int num_orphans;
+
+    v6fs_fsck_t report;
+} fsck_type;
+
+//a valid entry of the directory being checked, sorted by name to find the names given twice
+typedef struct {
+    char name[29];
+    long long addr;
+    unsigned int iNumber;
+} fsck_name_type;
+
+//state of one worker thread
+typedef struct {
+    fsck_type* check;
+    fsck_dir_type* dirs;
+    int num_dirs;
+    int max_dirs;
+    pthread_t thread;
+} fsck_worker_type;
+
+//adding a patch, called with the lock held
+void fsckPatch(fsck_type* check,long long addr,const void* data,int len){
+    if(check->num_patches == check->max_patches){
+        check->max_patches = check->max_patches == 0 ? 64 : 2*check->max_patches;
+        check->patches = realloc(check->patches,sizeof(fsck_patch_type) * check->max_patches);
+    }
+    fsck_patch_type* patch = &check->patches[check->num_patches++];
+    patch->addr = addr;
+    patch->len = len;
+    memcpy(patch->data,data,len);
+}
+
+/*
+fsckProblem() - reports a problem
+parameters: addr, data, len - patch repairing it, len 0 when it can't be repaired
+*/
+void fsckProblem(fsck_type* check,long long addr,const void* data,int len,const char* format,...){
+    if(check->releasing)
+        return;
+
+    pthread_mutex_lock(&check->lock);
+    check->report.problems++;
+    if(check->out != NULL){
+        va_list args;
+        va_start(args,format);
+        vfprintf(check->out,format,args);
+        va_end(args);
+        fputc('\n',check->out);
+    }
+    if(check->repair && len > 0)
+        fsckPatch(check,addr,data,len);
+    pthread_mutex_unlock(&check->lock);
+}
+
+//reading num_blocks blocks starting at bNumber, a short read is reported
+int fsckRead(fsck_type* check,int bNumber,void* buf,int num_blocks){
+    V6FS_STAT(check->fs,reads,1);
+    ssize_t n = pread(check->fs->fd,buf,(size_t)num_blocks*BLOCKSIZE,(off_t)BLOCKSIZE*bNumber);
+    if(n != (ssize_t)num_blocks*BLOCKSIZE){
+        fsckProblem(check,0,NULL,0,"cannot read blocks %d to %d",bNumber,bNumber + num_blocks - 1);
+        return V6FS_EIO;
+    }
+    V6FS_STAT(check->fs,read_bytes,n);
+    return V6FS_OK;
+}
+
+//byte address of inode iNumber in the image
+long long fsckInodeAddr(int iNumber){
+    return (long long)BLOCKSIZE*(2 + (iNumber-1)/16) + ((iNumber-1)%16)*INODESIZE;
+}
+
+/*
+fsckClaim() - claims block bNumber for inode iNumber
+parameters: addr - byte address of the pointer to the block, cleared by the repair when the block is out of range
+description: returns 1 when the block is the inode's alone, so its contents can be followed
+*/
+int fsckClaim(fsck_type* check,int iNumber,unsigned int bNumber,long long addr){
+    if(bNumber < (unsigned int)check->data_start || bNumber >= (unsigned int)check->data_end){
+        unsigned int zero = 0;
+        fsckProblem(check,addr,&zero,sizeof(zero),"inode %d: block %u is not a data block",iNumber,bNumber);
+        return 0;
+    }
+
+    unsigned long long bit = 1ULL << (bNumber%64);
+    if(check->releasing){
+        if(check->shared[bNumber/64] & bit)
+            return 0;
+        check->used[bNumber/64] &= ~bit;
+        return 1;
+    }
+
+    if(__atomic_fetch_or(&check->used[bNumber/64],bit,__ATOMIC_RELAXED) & bit){
+        __atomic_fetch_or(&check->shared[bNumber/64],bit,__ATOMIC_RELAXED);
+        fsckProblem(check,0,NULL,0,"inode %d: block %u is used by another inode too",iNumber,bNumber);
+        return 0;
+    }
+    return 1;
+}
+
+//claiming a data block, blocks past the end of the file are cleared by the repair instead
+void fsckDataBlock(fsck_type* check,int iNumber,unsigned int bNumber,long long addr,long long lbn,long long num_blocks){
+    if(lbn >= num_blocks){
+        unsigned int zero = 0;
+        fsckProblem(check,addr,&zero,sizeof(zero),"inode %d: block %u is past the end of the file",iNumber,bNumber);
+        return;
+    }
+    fsckClaim(check,iNumber,bNumber,addr);
+}
+
+//claiming the data blocks listed in the indirect block bNumber, the first of which is logical block first_lbn
+void fsckIndirect(fsck_type* check,int iNumber,unsigned int bNumber,long long first_lbn,long long num_blocks){
+    unsigned int entries[PTRS_PER_BLOCK];
+    if(fsckRead(check,bNumber,entries,1) < 0)
+        return;
+
+    int j;
+    for(j=0;j<PTRS_PER_BLOCK;j++){
+        if(entries[j] != 0)
+            fsckDataBlock(check,iNumber,entries[j],(long long)BLOCKSIZE*bNumber + 4*j,first_lbn + j,num_blocks);
+    }
+}
+
+//claiming every block of an inode, following the indirect and double indirect blocks of a large file
+void fsckFileBlocks(fsck_type* check,int iNumber,inode_type* inode){
+    long long base = fsckInodeAddr(iNumber) + offsetof(inode_type,addr);
+    long long num_blocks = (getFileSize(inode) + BLOCKSIZE - 1)/BLOCKSIZE;
+    if(check->kind[iNumber] == FSCK_DIR)
+        num_blocks = LLONG_MAX; //the size of a directory counts its entries, not its blocks
+    int i;
+
+    if((inode->flags & LARGEFILE) == 0){
+        for(i=0;i<9;i++){
+            if(inode->addr[i] != 0)
+                fsckDataBlock(check,iNumber,inode->addr[i],base + 4*i,i,num_blocks);
+        }
+        return;
+    }
+
+    for(i=0;i<9;i++){
+        if(inode->addr[i] == 0 || fsckClaim(check,iNumber,inode->addr[i],base + 4*i) == 0)
+            continue;
+        if(i < NUM_INDIRECT){
+            fsckIndirect(check,iNumber,inode->addr[i],(long long)i*PTRS_PER_BLOCK,num_blocks);
+            continue;
+        }
+
+        unsigned int dind[PTRS_PER_BLOCK];
+        if(fsckRead(check,inode->addr[i],dind,1) < 0)
+            continue;
+        long long first_lbn = NUM_INDIRECT*PTRS_PER_BLOCK + (long long)(i - NUM_INDIRECT)*PTRS_PER_BLOCK*PTRS_PER_BLOCK;
+        int j;
+        for(j=0;j<PTRS_PER_BLOCK;j++){
+            if(dind[j] != 0 && fsckClaim(check,iNumber,dind[j],(long long)BLOCKSIZE*inode->addr[i] + 4*j))
+                fsckIndirect(check,iNumber,dind[j],first_lbn + (long long)j*PTRS_PER_BLOCK,num_blocks);
+        }
+    }
+}
+
+//recording the type of an allocated inode and claiming its blocks
+void fsckInode(fsck_worker_type* worker,int iNumber,inode_type* inode){
+    fsck_type* check = worker->check;
+    if((inode->flags & 1<<15) == 0)
+        return;
+
+    check->nlinks[iNumber] = inode->nlinks;
+    int type = inode->flags & (3<<13);
+    if(type == 1<<14){
+        check->kind[iNumber] = FSCK_DIR;
+        if(inode->addr[0] == 0)
+            fsckProblem(check,0,NULL,0,"directory %d has no first block",iNumber);
+
+        if(worker->num_dirs == worker->max_dirs){
+            worker->max_dirs = worker->max_dirs == 0 ? 64 : 2*worker->max_dirs;
+            worker->dirs = realloc(worker->dirs,sizeof(fsck_dir_type) * worker->max_dirs);
+        }
+        worker->dirs[worker->num_dirs].iNumber = iNumber;
+        worker->dirs[worker->num_dirs].inode = *inode;
+        worker->num_dirs++;
+    }else{
+        check->kind[iNumber] = FSCK_FILE;
+        if(type != 0)
+            fsckProblem(check,0,NULL,0,"inode %d has an unknown file type",iNumber);
+        if(getFileSize(inode) > (long long)(NUM_INDIRECT*PTRS_PER_BLOCK + 2*PTRS_PER_BLOCK*PTRS_PER_BLOCK)*BLOCKSIZE)
+            fsckProblem(check,0,NULL,0,"inode %d is larger than its block map can address",iNumber);
+    }
+    fsckFileBlocks(check,iNumber,inode);
+}
+
+//first pass, the workers scan chunks of the inode table until none is left
+void* fsckScanWorker(void* arg){
+    fsck_worker_type* worker = arg;
+    fsck_type* check = worker->check;
+    int isize = check->fs->superBlock.isize;
+    char* buf = malloc((size_t)FSCK_CHUNK_BLOCKS*BLOCKSIZE);
+
+    while(1){
+        int chunk = __atomic_fetch_add(&check->next_chunk,1,__ATOMIC_RELAXED);
+        if(chunk >= check->num_chunks)
+            break;
+
+        int first = chunk*FSCK_CHUNK_BLOCKS;
+        int num = isize - first < FSCK_CHUNK_BLOCKS ? isize - first : FSCK_CHUNK_BLOCKS;
+        if(fsckRead(check,2 + first,buf,num) < 0)
+            continue;
+        int k;
+        for(k=0;k<num*16;k++)
+            fsckInode(worker,first*16 + k + 1,(inode_type*)(buf + k*INODESIZE));
+    }
+    free(buf);
+    return NULL;
+}
+
+//checking the . (e 0) or .. (e 1) entry at the start of directory d, the inode of .. is checked once parents are known
+void fsckDots(fsck_type* check,int d,dir_type* entry,long long addr,int e){
+    dir_type expected;
+    memset(&expected,0,sizeof(expected));
+    expected.inode = e == 0 ? (unsigned int)d : entry->inode;
+    strcpy(expected.filename,e == 0 ? "." : "..");
+    if(e == 1)
+        check->dotdot[d] = entry->inode;
+
+    if(entry->inode != expected.inode || memcmp(entry->filename,expected.filename,sizeof(expected.filename)) != 0)
+        fsckProblem(check,addr,&expected,sizeof(expected),"directory %d: bad %s entry",d,expected.filename);
+}
+
+int fsckIsData(fsck_type* check,unsigned int bNumber){
+    return bNumber >= (unsigned int)check->data_start && bNumber < (unsigned int)check->data_end;
+}
+
+//recording bNumber as logical block lbn of a directory
+void fsckMapBlock(unsigned int** map,long long* num_lbns,long long* max_lbns,long long lbn,unsigned int bNumber){
+    if(lbn >= *max_lbns){
+        long long max = *max_lbns;
+        while(max <= lbn)
+            max = max == 0 ? 16 : 2*max;
+        *map = realloc(*map,sizeof(unsigned int) * max);
+        memset(*map + *max_lbns,0,sizeof(unsigned int) * (max - *max_lbns));
+        *max_lbns = max;
+    }
+    (*map)[lbn] = bNumber;
+    if(lbn >= *num_lbns)
+        *num_lbns = lbn + 1;
+}
+
+//mapping the logical blocks of a directory, pointers outside the data blocks were reported by the scan and are skipped
+long long fsckDirMap(fsck_type* check,inode_type* inode,unsigned int** map){
+    long long num_lbns = 0;
+    long long max_lbns = 0;
+    *map = NULL;
+    int i;
+
+    if((inode->flags & LARGEFILE) == 0){
+        for(i=0;i<9;i++){
+            if(fsckIsData(check,inode->addr[i]))
+                fsckMapBlock(map,&num_lbns,&max_lbns,i,inode->addr[i]);
+        }
+        return num_lbns;
+    }
+
+    unsigned int entries[PTRS_PER_BLOCK];
+    unsigned int dind[PTRS_PER_BLOCK];
+    for(i=0;i<9;i++){
+        if(fsckIsData(check,inode->addr[i]) == 0)
+            continue;
+        int num_ind = 1;
+        long long first_lbn = (long long)i*PTRS_PER_BLOCK;
+        dind[0] = inode->addr[i];
+        if(i >= NUM_INDIRECT){
+            if(fsckRead(check,inode->addr[i],dind,1) < 0)
+                continue;
+            num_ind = PTRS_PER_BLOCK;
+            first_lbn = NUM_INDIRECT*PTRS_PER_BLOCK + (long long)(i - NUM_INDIRECT)*PTRS_PER_BLOCK*PTRS_PER_BLOCK;
+        }
+
+        int k;
+        for(k=0;k<num_ind;k++){
+            if(fsckIsData(check,dind[k]) == 0 || fsckRead(check,dind[k],entries,1) < 0)
+                continue;
+            int j;
+            for(j=0;j<PTRS_PER_BLOCK;j++){
+                if(fsckIsData(check,entries[j]))
+                    fsckMapBlock(map,&num_lbns,&max_lbns,first_lbn + (long long)k*PTRS_PER_BLOCK + j,entries[j]);
+            }
+        }
+    }
+    return num_lbns;
+}
+
+//the index block at logical block lbn, NULL when lbn is not a valid index block
+dir_index_header_type* fsckIndexBlock(char* data,unsigned int* map,long long num_lbns,unsigned int lbn){
+    if(lbn >= num_lbns || map[lbn] == 0)
+        return NULL;
+    dir_index_header_type* header = (dir_index_header_type*)(data + (long long)lbn*BLOCKSIZE);
+    if(header->inode != 0 || header->magic != DIR_INDEX_MAGIC || header->count == 0 || header->count > DIR_NODE_ENTRIES)
+        return NULL;
+    return header;
+}
+
+/*
+fsckIndex() - checks the index of a directory read into data
+parameters: is_node - set for logical block 0 and the blocks holding index blocks, going by their magic
+description: returns 0 when an entry points outside the directory or at a missing block, or the hashes of a block
+            are not increasing
+*/
+int fsckIndex(dir_index_header_type* root,char* data,unsigned int* map,long long num_lbns,char* is_node){
+    if(root->count == 0 || root->count > DIR_ROOT_ENTRIES || root->levels > 1 || root->num_blocks > num_lbns)
+        return 0;
+
+    int k;
+    for(k=0;k<root->count;k++){
+        dir_index_entry_type* entry = dirIndexEntry(root,k);
+        if(k > 0 && entry->hash <= dirIndexEntry(root,k-1)->hash)
+            return 0;
+        if(entry->lbn == 0 || entry->lbn >= num_lbns || map[entry->lbn] == 0 || is_node[entry->lbn] != root->levels)
+            return 0;
+        if(root->levels == 0)
+            continue;
+
+        dir_index_header_type* node = fsckIndexBlock(data,map,num_lbns,entry->lbn);
+        if(node == NULL)
+            return 0;
+        int j;
+        for(j=0;j<node->count;j++){
+            dir_index_entry_type* leaf = dirIndexEntry(node,j);
+            if(j > 0 && leaf->hash <= dirIndexEntry(node,j-1)->hash)
+                return 0;
+            if(leaf->lbn == 0 || leaf->lbn >= num_lbns || map[leaf->lbn] == 0 || is_node[leaf->lbn])
+                return 0;
+        }
+    }
+    return 1;
+}
+
+//the leaf the index sends a name hashing to hash to
+unsigned int fsckIndexLeaf(dir_index_header_type* root,char* data,unsigned int hash){
+    unsigned int lbn = dirIndexEntry(root,dirIndexSearch(root,hash))->lbn;
+    if(root->levels == 0)
+        return lbn;
+    dir_index_header_type* node = (dir_index_header_type*)(data + (long long)lbn*BLOCKSIZE);
+    return dirIndexEntry(node,dirIndexSearch(node,hash))->lbn;
+}
+
+//dropping the index of directory d, the slots of the root and the index blocks become free entries
+void fsckDropIndex(fsck_type* check,int d,unsigned int* map,long long num_lbns,char* is_node){
+    fsckProblem(check,0,NULL,0,"directory %d: bad index, scanned linearly",d);
+    if(check->repair == 0)
+        return;
+
+    dir_type cleared;
+    memset(&cleared,0,sizeof(cleared));
+    cleared.inode = -1;
+    pthread_mutex_lock(&check->lock);
+    long long lbn;
+    for(lbn=0;lbn<num_lbns;lbn++){
+        if(is_node[lbn] == 0)
+            continue;
+        int e;
+        for(e=lbn == 0 ? 2 : 0;e<(int)(BLOCKSIZE/sizeof(dir_type));e++)
+            fsckPatch(check,(long long)BLOCKSIZE*map[lbn] + e*sizeof(dir_type),&cleared,sizeof(cleared));
+    }
+    pthread_mutex_unlock(&check->lock);
+}
+
+//ordering entries by name, and the entries of one name by their place in the directory
+int fsckNameCompare(const void* a,const void* b){
+    const fsck_name_type* x = a;
+    const fsck_name_type* y = b;
+    int cmp = strcmp(x->name,y->name);
+    if(cmp != 0)
+        return cmp;
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/*
+fsckDirectory() - counts the names in a directory
+description: entries naming a free or invalid inode are cleared by the repair. In an indexed directory the slots of the
+            root and the index blocks are skipped, and every name must be in the leaf the index sends its hash to.
+            The valid entries are sorted by name once read, a name found again is cleared by the repair and not counted,
+            the inode it named is then freed if no other entry names it
+*/
+void fsckDirectory(fsck_type* check,fsck_dir_type* dir){
+    int d = dir->iNumber;
+    long long used = 0;
+    dir_type cleared;
+    memset(&cleared,0,sizeof(cleared));
+    cleared.inode = -1;
+
+    unsigned int* map;
+    long long num_lbns = fsckDirMap(check,&dir->inode,&map);
+    char* data = malloc((size_t)num_lbns*BLOCKSIZE + 1);
+    char* is_node = calloc(num_lbns + 1,1);
+    long long lbn;
+    for(lbn=0;lbn<num_lbns;lbn++){
+        if(map[lbn] != 0 && fsckRead(check,map[lbn],data + lbn*BLOCKSIZE,1) < 0)
+            map[lbn] = 0;
+    }
+    if(num_lbns > 0 && map[0] != 0)
+        check->first_block[d] = map[0];
+
+    dir_index_header_type* root = NULL;
+    if(num_lbns > 0 && map[0] != 0)
+        root = dirIndex(data);
+    is_node[0] = root != NULL;
+    for(lbn=1;root != NULL && lbn<num_lbns;lbn++){
+        dir_index_header_type* header = (dir_index_header_type*)(data + lbn*BLOCKSIZE);
+        is_node[lbn] = map[lbn] != 0 && header->inode == 0 && header->magic == DIR_INDEX_MAGIC;
+    }
+    if(root != NULL && fsckIndex(root,data,map,num_lbns,is_node) == 0){
+        fsckDropIndex(check,d,map,num_lbns,is_node);
+        root = NULL;
+    }
+    int misplaced = 0;
+    fsck_name_type* names = malloc(sizeof(fsck_name_type) * (num_lbns*(BLOCKSIZE/sizeof(dir_type)) + 1));
+    int num_names = 0;
+
+    for(lbn=0;lbn<num_lbns;lbn++){
+        unsigned int bNumber = map[lbn];
+        if(bNumber == 0 || (lbn > 0 && is_node[lbn]))
+            continue;
+        dir_type* entries = (dir_type*)(data + lbn*BLOCKSIZE);
+
+        int e;
+        for(e=0;e<(int)(BLOCKSIZE/sizeof(dir_type));e++){
+            dir_type* entry = &entries[e];
+            long long addr = (long long)BLOCKSIZE*bNumber + e*sizeof(dir_type);
+            if(lbn == 0 && e < 2){
+                fsckDots(check,d,entry,addr,e);
+                used++;
+                continue;
+            }
+            if(lbn == 0 && is_node[0])
+                break; //index slots, cleared by the repair when the index is dropped
+            if(entry->inode == (unsigned int)-1)
+                continue;
+
+            char name[29];
+            memcpy(name,entry->filename,28);
+            name[28] = '\0';
+            unsigned int iNumber = entry->inode;
+            if(iNumber == 0 || iNumber > (unsigned int)check->num_inodes){
+                fsckProblem(check,addr,&cleared,sizeof(cleared),"directory %d: %s names invalid inode %u",d,name,iNumber);
+                continue;
+            }
+            if(check->kind[iNumber] == FSCK_FREE){
+                fsckProblem(check,addr,&cleared,sizeof(cleared),"directory %d: %s names free inode %u",d,name,iNumber);
+                continue;
+            }
+            if(name[0] == '\0' || strcmp(name,".") == 0 || strcmp(name,"..") == 0 || strchr(name,'/') != NULL){
+                fsckProblem(check,addr,&cleared,sizeof(cleared),"directory %d: bad name \"%s\" for inode %u",d,name,iNumber);
+                continue;
+            }
+            if(root != NULL && fsckIndexLeaf(root,data,dirHash(name)) != lbn)
+                misplaced = 1;
+
+            fsck_name_type* found = &names[num_names++];
+            memcpy(found->name,name,sizeof(name));
+            found->addr = addr;
+            found->iNumber = iNumber;
+        }
+    }
+
+    qsort(names,num_names,sizeof(fsck_name_type),fsckNameCompare);
+    int i;
+    for(i=0;i<num_names;i++){
+        unsigned int iNumber = names[i].iNumber;
+        if(i > 0 && strcmp(names[i].name,names[i-1].name) == 0){
+            fsckProblem(check,names[i].addr,&cleared,sizeof(cleared),"directory %d: name %s appears twice, for inode %u",
+                d,names[i].name,iNumber);
+            continue;
+        }
+        used++;
+        __atomic_fetch_add(&check->refs[iNumber],1,__ATOMIC_RELAXED);
+        __atomic_store_n(&check->parent[iNumber],d,__ATOMIC_RELAXED);
+    }
+    free(names);
+    if(misplaced)
+        fsckDropIndex(check,d,map,num_lbns,is_node);
+    free(is_node);
+    free(data);
+    free(map);
+
+    //a directory's size counts its entries in use, . and .. included
+    if(getFileSize(&dir->inode) != used*32){
+        unsigned int size[2] = {0,(unsigned int)(used*32)};
+        fsckProblem(check,fsckInodeAddr(d) + offsetof(inode_type,size0),size,sizeof(size),
+            "directory %d: size %lld, %lld entries in use",d,getFileSize(&dir->inode),used);
+    }
+}
+
+//second pass, every worker checks the directories its scan found
+void* fsckDirWorker(void* arg){
+    fsck_worker_type* worker = arg;
+    int i;
+    for(i=0;i<worker->num_dirs;i++)
+        fsckDirectory(worker->check,&worker->dirs[i]);
+    return NULL;
+}
+
+//putting block bNumber on the free map, returns 0 when it can't be on the free chain
+int fsckFreeBlock(fsck_type* check,unsigned int bNumber){
+    if(bNumber < (unsigned int)check->data_start || bNumber >= (unsigned int)check->data_end){
+        fsckProblem(check,0,NULL,0,"free list: block %u is not a data block",bNumber);
+        check->free_chain_bad = 1;
+        return 0;
+    }
+
+    unsigned long long bit = 1ULL << (bNumber%64);
+    if(check->free_map[bNumber/64] & bit){
+        fsckProblem(check,0,NULL,0,"free list: block %u is listed twice",bNumber);
+        check->free_chain_bad = 1;
+        return 0;
+    }
+    check->free_map[bNumber/64] |= bit;
+    check->report.blocks_free++;
+
+    if(check->used[bNumber/64] & bit){
+        fsckProblem(check,0,NULL,0,"free list: block %u is in use",bNumber);
+        check->free_chain_bad = 1;
+    }
+    return 1;
+}
+
+//walking the free chain in the format addFreeBlock(fs) builds, the walk ends at the first bad chain block
+void fsckFreeChain(fsck_type* check){
+    superblock_type* sb = &check->fs->superBlock;
+    unsigned int chain[PTRS_PER_BLOCK]; //a whole chain block is read, only the first 252 entries are used
+    int nfree = sb->nfree;
+    memcpy(chain + 1,sb->free,sizeof(sb->free));
+
+    while(nfree > 0){
+        if(nfree > 251){
+            fsckProblem(check,0,NULL,0,"free list: %d blocks in one list",nfree);
+            check->free_chain_bad = 1;
+            break;
+        }
+        int k;
+        for(k=1;k<nfree;k++)
+            fsckFreeBlock(check,chain[k+1]);
+
+        if(chain[1] == 0 || fsckFreeBlock(check,chain[1]) == 0)
+            break;
+        if(fsckRead(check,chain[1],chain,1) < 0){
+            check->free_chain_bad = 1;
+            break;
+        }
+        nfree = chain[0];
+    }
+
+    long long lost = 0;
+    int bNumber;
+    for(bNumber=check->data_start;bNumber<check->data_end;bNumber++){
+        unsigned long long bit = 1ULL << (bNumber%64);
+        if(((check->used[bNumber/64] | check->free_map[bNumber/64]) & bit) == 0)
+            lost++;
+    }
+    if(lost > 0){
+        fsckProblem(check,0,NULL,0,"free list: %lld blocks are neither in use nor free",lost);
+        check->free_chain_bad = 1;
+    }
+}
+
+//comparing link counts with the names found and .. with the directory holding each directory
+void fsckLinks(fsck_type* check){
+    int iNumber;
+    for(iNumber=1;iNumber<=check->num_inodes;iNumber++){
+        int kind = check->kind[iNumber];
+        if(kind == FSCK_FREE)
+            continue;
+        check->report.inodes++;
+        if(kind == FSCK_DIR)
+            check->report.directories++;
+
+        unsigned int refs = check->refs[iNumber];
+        if(iNumber == 1){
+            if(refs > 0)
+                fsckProblem(check,0,NULL,0,"root directory is named in directory %u",check->parent[1]);
+            refs = 1; //the root has no name but a link count of 1
+        }else if(refs == 0 && kind == FSCK_FILE){
+            char zeros[INODESIZE];
+            memset(zeros,0,sizeof(zeros));
+            fsckProblem(check,fsckInodeAddr(iNumber),zeros,sizeof(zeros),"inode %d is in no directory",iNumber);
+            if(check->repair){
+                check->orphans[check->num_orphans++] = iNumber;
+                inode_type copy;
+                readInodeFromFS(check->fs,iNumber,&copy);
+                check->releasing = 1;
+                fsckFileBlocks(check,iNumber,&copy);
+                check->releasing = 0;
+            }
+            continue;
+        }else if(refs == 0){
+            fsckProblem(check,0,NULL,0,"directory %d is in no directory",iNumber);
+            continue;
+        }
+
+        if(kind == FSCK_DIR && refs > 1)
+            fsckProblem(check,0,NULL,0,"directory %d is named in %u directories",iNumber,refs);
+
+        if(check->nlinks[iNumber] != (kind == FSCK_DIR ? 1 : refs)){
+            unsigned short nlinks = kind == FSCK_DIR ? 1 : refs;
+            fsckProblem(check,fsckInodeAddr(iNumber) + offsetof(inode_type,nlinks),&nlinks,sizeof(nlinks),
+                "inode %d: link count %d, %u names",iNumber,check->nlinks[iNumber],refs);
+        }
+
+        unsigned int parent = iNumber == 1 ? 1 : check->parent[iNumber];
+        unsigned int first_block = check->first_block[iNumber];
+        if(kind == FSCK_DIR && check->dotdot[iNumber] != parent
+            && first_block >= (unsigned int)check->data_start && first_block < (unsigned int)check->data_end)
+            fsckProblem(check,(long long)BLOCKSIZE*first_block + sizeof(dir_type),&parent,sizeof(parent),
+                "directory %d: .. is %u instead of %u",iNumber,check->dotdot[iNumber],parent);
+    }
+}
+
+//running one pass on num_workers threads
+void fsckRun(fsck_worker_type* workers,int num_workers,void* (*pass)(void*)){
+    int i;
+    for(i=0;i<num_workers;i++)
+        pthread_create(&workers[i].thread,NULL,pass,&workers[i]);
+    for(i=0;i<num_workers;i++)
+        pthread_join(workers[i].thread,NULL);
+}
+
+//applying the patches, freeing the orphaned inodes and writing a new free chain of the blocks no inode claims
+void fsckRepair(fsck_type* check){
+    v6fs_t* fs = check->fs;
+    icacheDestroy(fs); //the patches change inode table blocks underneath the cached inodes
+    int i;
+    for(i=0;i<check->num_patches;i++){
+        fsck_patch_type* patch = &check->patches[i];
+        int bNumber = patch->addr/BLOCKSIZE;
+        memcpy(getBlock(fs,bNumber) + patch->addr%BLOCKSIZE,patch->data,patch->len);
+        markBlockDirty(fs,bNumber);
+        check->report.repaired++;
+    }
+    for(i=0;i<check->num_orphans;i++)
+        releaseInode(fs,check->orphans[i]);
+
+    if(check->free_chain_bad || check->num_orphans > 0 || check->num_patches > 0){
+        allocBlockBitmap(fs,fs->superBlock.fsize);
+        int bNumber;
+        for(bNumber=check->data_start;bNumber<check->data_end;bNumber++){
+            if((check->used[bNumber/64] & (1ULL << (bNumber%64))) == 0)
+                fs->block_bitmap[bNumber/64] |= 1ULL << (bNumber%64);
+        }
+        journalReserve(fs,freeChainBlocks(fs));
+        writeFreeChain(fs);
+        if(fs->extent_alloc == 0){
+            free(fs->block_bitmap);
+            fs->block_bitmap = NULL;
+        }
+        if(check->free_chain_bad)
+            check->report.repaired++;
+    }
+
+    dentryClear(fs);
+    readInodeFromFS(fs,1,&fs->root_inode);
+    syncFS(fs);
+}
+
+/*
+fsck() - checks the open image, see v6fs_fsck()
+description: returns the number of problems found
+*/
+int fsck(v6fs_t* fs,int flags,int num_threads,FILE* out,v6fs_fsck_t* report){
+    fsck_type check;
+    memset(&check,0,sizeof(check));
+    check.fs = fs;
+    check.repair = (flags & V6FS_FSCK_REPAIR) != 0;
+    check.out = out;
+    pthread_mutex_init(&check.lock,NULL);
+
+    //everything cached or mapped reaches the image before it is read around the cache
+    syncFS(fs);
+
+    superblock_type* sb = &fs->superBlock;
+    check.data_start = sb->isize + 2;
+    check.data_end = fs->journal_blocks > 0 ? fs->journal_start : (int)sb->fsize;
+    check.num_inodes = sb->isize*16;
+
+    struct stat st;
+    if(fstat(fs->fd,&st) == -1 || st.st_size < (off_t)BLOCKSIZE*sb->fsize){
+        fsckProblem(&check,0,NULL,0,"the image is shorter than its %u blocks",sb->fsize);
+    }else if(sb->isize == 0 || check.data_start >= check.data_end){
+        fsckProblem(&check,0,NULL,0,"superblock: %u inode blocks in %u blocks",sb->isize,sb->fsize);
+    }else{
+        check.kind = calloc(check.num_inodes + 1,sizeof(unsigned char));
+        check.nlinks = calloc(check.num_inodes + 1,sizeof(unsigned short));
+        check.refs = calloc(check.num_inodes + 1,sizeof(unsigned int));
+        check.parent = calloc(check.num_inodes + 1,sizeof(unsigned int));
+        check.dotdot = calloc(check.num_inodes + 1,sizeof(unsigned int));
+        check.first_block = calloc(check.num_inodes + 1,sizeof(unsigned int));
+        check.orphans = malloc(sizeof(int) * (check.num_inodes + 1));
+        int words = (sb->fsize + 63)/64;
+        check.used = calloc(words,sizeof(unsigned long long));
+        check.shared = calloc(words,sizeof(unsigned long long));
+        check.free_map = calloc(words,sizeof(unsigned long long));
+
+        check.num_chunks = (sb->isize + FSCK_CHUNK_BLOCKS - 1)/FSCK_CHUNK_BLOCKS;
+        if(num_threads <= 0)
+            num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if(num_threads <= 0)
+            num_threads = 1;
+        if(num_threads > check.num_chunks)
+            num_threads = check.num_chunks;
+
+        fsck_worker_type* workers = calloc(num_threads,sizeof(fsck_worker_type));
+        int i;
+        for(i=0;i<num_threads;i++)
+            workers[i].check = &check;
+        fsckRun(workers,num_threads,fsckScanWorker);
+
+        if(check.kind[1] != FSCK_DIR)
+            fsckProblem(&check,0,NULL,0,"inode 1 is not a directory");
+        fsckRun(workers,num_threads,fsckDirWorker);
+
+        fsckFreeChain(&check);
+        int w;
+        for(w=0;w<words;w++)
+            check.report.blocks_used = check.report.blocks_used + __builtin_popcountll(check.used[w]);
+        fsckLinks(&check);
+
+        if(check.repair && check.report.problems > 0)
+            fsckRepair(&check);
+        V6FS_DEBUG(fs,"fsck checked %lld inodes with %d threads",check.report.inodes,num_threads);
+
+        for(i=0;i<num_threads;i++)
+            free(workers[i].dirs);
+        free(workers);
+        free(check.kind);
+        free(check.nlinks);
+        free(check.refs);
+        free(check.parent);
+        free(check.dotdot);
+        free(check.first_block);
+        free(check.orphans);
+        free(check.used);
+        free(check.shared);
+        free(check.free_map);
+        free(check.patches);
+    }
+
+    pthread_mutex_destroy(&check.lock);
+    if(report != NULL)
+        *report = check.report;
+    return check.report.problems;
+}
+
+int v6fs_fsck(v6fs_t* fs,int flags,int num_threads,FILE* out,v6fs_fsck_t* report){
+    long long start = statsClock();
+    pthread_mutex_lock(&fs->lock);
+    bulkWait(fs); //a file being imported is in no directory until its copy is done
+    int status = V6FS_ENOTFORMATTED;
+    if(fs->superBlock.fsize > 0)
+        status = fsck(fs,flags,num_threads,out,report);
+    endCall(fs);
+    statsRecord(fs,V6FS_OP_FSCK,start);
+    pthread_mutex_unlock(&fs->lock);
+    return status;
+}
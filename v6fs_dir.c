@@ -0,0 +1,659 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "v6fs_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define V6FS_HAVE_SIMD 1
+#endif
+
+/*
+Directories
+a directory is a file of 32 byte entries mapped through the same block map as plain files, so past 9 blocks it is
+switched to indirect blocks like a large file. A linear directory is scanned block by block. With the dir_index
+option on, a directory whose blocks are full is converted to an indexed one when it would grow a new block: its
+names are sorted by hash into leaf blocks and the root and index blocks map hash ranges onto the leaves. A lookup
+then reads the root, at most one index block and one leaf, and a full leaf is split in two instead of scanning
+the directory for room
+*/
+
+#define DIR_ENTRIES (BLOCKSIZE/(int)sizeof(dir_type))
+
+//the index blocks followed to reach a leaf
+typedef struct {
+    int levels;
+    int k[2]; //entry followed in the root and in the index block
+    int node_lbn; //index block below the root when levels is 1
+    int leaf_lbn;
+} dir_path_type;
+
+//a name with its hash, sorted when leaves are filled
+typedef struct {
+    unsigned int hash;
+    dir_type entry;
+} dir_hashed_type;
+
+/*
+Block matching
+a directory block is searched by comparing the whole 32 byte entry, inode included, against a key holding the name
+padded with NULs, which is how every entry is written. The bytes of the inode only take part in finding the first free
+entry (inode -1) in the same pass. dirMatchSelect() picks the AVX2 or SSE2 kernel the CPU supports at run time, the
+scalar one elsewhere
+*/
+
+//a key no entry holds since names can't contain /, for searches of the free entry alone
+char dir_no_name[28] = "/";
+
+//the name padded with NULs to the 28 bytes of an entry
+void dirKey(char* key,char* name){
+    memset(key,0,28);
+    memcpy(key,name,strnlen(name,28));
+}
+
+int dirMatchScalar(dir_type* entries,char* key,int* free_slot){
+    int i;
+    for(i=0;i<DIR_ENTRIES;i++){
+        if(entries[i].inode == (unsigned int)-1){
+            if(*free_slot == -1)
+                *free_slot = i;
+            continue;
+        }
+        if(memcmp(entries[i].filename,key,28) == 0)
+            return i;
+    }
+    return -1;
+}
+
+#ifdef V6FS_HAVE_SIMD
+
+//one entry in two halves, bytes 0-3 of the first are the inode
+__attribute__((target("sse2")))
+int dirMatchSSE2(dir_type* entries,char* key,int* free_slot){
+    char padded[32];
+    memset(padded,0,4);
+    memcpy(padded + 4,key,28);
+    __m128i lo = _mm_loadu_si128((__m128i*)padded);
+    __m128i hi = _mm_loadu_si128((__m128i*)(padded + 16));
+    __m128i ones = _mm_set1_epi8(-1);
+
+    int i;
+    for(i=0;i<DIR_ENTRIES;i++){
+        __m128i a = _mm_loadu_si128((__m128i*)&entries[i]);
+        __m128i b = _mm_loadu_si128((__m128i*)&entries[i] + 1);
+        if((_mm_movemask_epi8(_mm_cmpeq_epi8(a,ones)) & 0xf) == 0xf){
+            if(*free_slot == -1)
+                *free_slot = i;
+            continue;
+        }
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a,lo)) | (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(b,hi)) << 16;
+        if((mask | 0xf) == 0xffffffff)
+            return i;
+    }
+    return -1;
+}
+
+//one entry per 256 bit compare, the byte masks of the free and the matching entries are built for the whole block
+__attribute__((target("avx2")))
+int dirMatchAVX2(dir_type* entries,char* key,int* free_slot){
+    char padded[32];
+    memset(padded,0,4);
+    memcpy(padded + 4,key,28);
+    __m256i target = _mm256_loadu_si256((__m256i*)padded);
+    __m256i ones = _mm256_set1_epi8(-1);
+
+    unsigned int free_mask = 0;
+    unsigned int match_mask = 0;
+    int i;
+    for(i=0;i<DIR_ENTRIES;i++){
+        __m256i entry = _mm256_loadu_si256((__m256i*)&entries[i]);
+        unsigned int is_free = (_mm256_movemask_epi8(_mm256_cmpeq_epi8(entry,ones)) & 0xf) == 0xf;
+        unsigned int equal = ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(entry,target)) | 0xf) == 0xffffffff;
+        free_mask |= is_free << i;
+        match_mask |= (equal & !is_free) << i;
+    }
+
+    if(*free_slot == -1 && free_mask != 0){
+        //the caller only uses the free entry when nothing matches, or when it comes before the match
+        int first = __builtin_ctz(free_mask);
+        if(match_mask == 0 || first < __builtin_ctz(match_mask))
+            *free_slot = first;
+    }
+    return match_mask != 0 ? __builtin_ctz(match_mask) : -1;
+}
+
+#endif
+
+dir_match_type dirMatchSelect(){
+#ifdef V6FS_HAVE_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return dirMatchAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return dirMatchSSE2;
+#endif
+    return dirMatchScalar;
+}
+
+unsigned int dirHash(char* name){
+    unsigned int hash = 2166136261u;
+    int i;
+    for(i=0;i<28 && name[i]!='\0';i++)
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    return hash;
+}
+
+//returns the index root in the first block of a directory, NULL for a linear directory
+dir_index_header_type* dirIndex(char* block){
+    dir_index_header_type* header = (dir_index_header_type*)(block + 2*sizeof(dir_type));
+    if(header->inode != 0 || header->magic != DIR_INDEX_MAGIC)
+        return NULL;
+    return header;
+}
+
+dir_index_entry_type* dirIndexEntry(dir_index_header_type* header,int k){
+    return &((dir_index_slot_type*)header)[1 + k/3].entries[k%3];
+}
+
+//returns the last entry whose hash is not above hash, the first entry covers everything below the second one
+int dirIndexSearch(dir_index_header_type* header,unsigned int hash){
+    int lo = 0;
+    int hi = header->count - 1;
+    while(lo < hi){
+        int mid = (lo + hi + 1)/2;
+        if(dirIndexEntry(header,mid)->hash <= hash)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+//inserting entry k, the entries from k on move up by one
+void dirIndexInsert(dir_index_header_type* header,int k,unsigned int hash,int lbn){
+    int i;
+    for(i=header->count;i>k;i--)
+        *dirIndexEntry(header,i) = *dirIndexEntry(header,i-1);
+    dirIndexEntry(header,k)->hash = hash;
+    dirIndexEntry(header,k)->lbn = lbn;
+    header->count++;
+}
+
+//clearing the header and the num_slots-1 slots after it, their inode stays 0 so a linear scan passes over them
+void dirIndexInit(dir_index_header_type* header,int num_slots){
+    memset(header,0,sizeof(dir_index_slot_type)*num_slots);
+    header->magic = DIR_INDEX_MAGIC;
+}
+
+//number of logical blocks to look at, a large linear directory ends at its first unmapped block
+int dirNumBlocks(v6fs_t* fs,open_file_type* dir){
+    int first = fileBlock(fs,dir,0,0);
+    if(first <= 0)
+        return 0;
+    dir_index_header_type* header = dirIndex(getBlock(fs,first));
+    if(header != NULL)
+        return header->num_blocks;
+    if((dir->inode.flags & LARGEFILE) == 0)
+        return 9;
+
+    int lbn = 9;
+    while(fileBlock(fs,dir,lbn,0) > 0)
+        lbn++;
+    return lbn;
+}
+
+//returns the block number of the leaf a name hashing to hash belongs in, 0 if the index is damaged
+int dirIndexLeaf(v6fs_t* fs,open_file_type* dir,unsigned int hash,dir_path_type* path){
+    dir_index_header_type* header = dirIndex(getBlock(fs,fileBlock(fs,dir,0,0)));
+    path->levels = header->levels;
+    path->k[0] = dirIndexSearch(header,hash);
+    int lbn = dirIndexEntry(header,path->k[0])->lbn;
+
+    if(path->levels == 1){
+        path->node_lbn = lbn;
+        int bNumber = fileBlock(fs,dir,lbn,0);
+        if(bNumber <= 0)
+            return 0;
+        header = (dir_index_header_type*)getBlock(fs,bNumber);
+        path->k[1] = dirIndexSearch(header,hash);
+        lbn = dirIndexEntry(header,path->k[1])->lbn;
+    }
+
+    path->leaf_lbn = lbn;
+    return lbn > 0 ? fileBlock(fs,dir,lbn,0) : 0;
+}
+
+/*
+dirLookup() - finds name in the directory iNumber
+description: returns the inode named, or -1 when it is not there. fs->addr_dir is set to the byte address of the
+            entry found, and fs->addr_inode to the directory. When the name is not found, the free entry the same
+            pass came across is kept for dirFreeSlot() adding that name next
+*/
+int dirLookup(v6fs_t* fs,int iNumber,char* name){
+    open_file_type dir;
+    openFile(fs,&dir,iNumber);
+    int first = fileBlock(fs,&dir,0,0);
+    if(first <= 0)
+        return -1;
+
+    char key[28];
+    dirKey(key,name);
+    int compared = 0;
+    int found = -1;
+    long long free_addr = -1;
+    if(dirIndex(getBlock(fs,first)) != NULL){
+        dir_path_type path;
+        int leaf = dirIndexLeaf(fs,&dir,dirHash(name),&path);
+        if(leaf > 0){
+            dir_type* directory = (dir_type*)getBlock(fs,leaf);
+            int free_slot = -1;
+            int dir_idx = fs->dir_match(directory,key,&free_slot);
+            compared = compared + (dir_idx == -1 ? DIR_ENTRIES : dir_idx + 1);
+            if(dir_idx != -1){
+                fs->addr_dir = (long long)BLOCKSIZE*leaf + 32*dir_idx;
+                found = directory[dir_idx].inode;
+            }else if(free_slot != -1){
+                free_addr = (long long)BLOCKSIZE*leaf + 32*free_slot;
+            }
+        }
+        //. and .. are in the first block, outside the leaves
+        if(found == -1 && (strcmp(name,".") == 0 || strcmp(name,"..") == 0)){
+            dir_type* directory = (dir_type*)getBlock(fs,first);
+            fs->addr_dir = (long long)BLOCKSIZE*first + (name[1] == '.' ? 32 : 0);
+            found = directory[name[1] == '.' ? 1 : 0].inode;
+        }
+    }else{
+        int num_blocks = dirNumBlocks(fs,&dir);
+        int lbn;
+        for(lbn=0;lbn<num_blocks && found == -1;lbn++){
+            int bNumber = fileBlock(fs,&dir,lbn,0);
+            if(bNumber <= 0)
+                continue;
+            dir_type* directory = (dir_type*)getBlock(fs,bNumber);
+            int free_slot = free_addr == -1 ? -1 : 0; //only the first free entry of the directory is wanted
+            int dir_idx = fs->dir_match(directory,key,&free_slot);
+            compared = compared + (dir_idx == -1 ? DIR_ENTRIES : dir_idx + 1);
+            if(dir_idx != -1){
+                fs->addr_dir = (long long)BLOCKSIZE*bNumber + 32*dir_idx;
+                found = directory[dir_idx].inode;
+            }else if(free_addr == -1 && free_slot != -1){
+                free_addr = (long long)BLOCKSIZE*bNumber + 32*free_slot;
+            }
+        }
+    }
+
+    V6FS_STAT(fs,dentries_compared,compared);
+    if(found != -1)
+        fs->addr_inode = iNumber;
+    fs->free_hint_dir = found == -1 && free_addr != -1 ? iNumber : 0;
+    fs->free_hint_addr = free_addr;
+    memcpy(fs->free_hint_name,key,28);
+    return found;
+}
+
+//allocating logical block lbn of a directory as an empty directory block, returns the block number
+int dirNewBlock(v6fs_t* fs,open_file_type* dir,int lbn){
+    int bNumber = fileBlock(fs,dir,lbn,1);
+    if(bNumber < 0)
+        return bNumber;
+    return allocateFreeBlockToDir(fs,bNumber,dir->iNumber,lbn == 0,dir->iNumber);
+}
+
+int compareHashed(const void* a,const void* b){
+    unsigned int x = ((dir_hashed_type*)a)->hash;
+    unsigned int y = ((dir_hashed_type*)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+//writing count entries to the start of the block bNumber, the rest of it is marked free
+void dirWriteLeaf(v6fs_t* fs,int bNumber,dir_hashed_type* names,int count){
+    dir_type* directory = (dir_type*)getEmptyBlock(fs,bNumber);
+    int i;
+    for(i=0;i<DIR_ENTRIES;i++){
+        if(i < count){
+            directory[i] = names[i].entry;
+        }else{
+            directory[i].inode = -1;
+            memset(directory[i].filename,'\0',sizeof(directory[i].filename));
+        }
+    }
+    markBlockDirty(fs,bNumber);
+}
+
+/*
+dirMakeIndex() - converts the full linear directory dir into an indexed one
+description: the names are sorted by hash and spread over the existing blocks and new ones, DIR_LEAF_FILL to a leaf
+            but never splitting names of equal hash between two leaves. Returns V6FS_EDIRFULL when they don't fit in
+            the two index levels or, on a journaled image, in the transaction, the directory is left linear then
+*/
+int dirMakeIndex(v6fs_t* fs,open_file_type* dir){
+    int num_blocks = dirNumBlocks(fs,dir);
+    dir_hashed_type* names = malloc(sizeof(dir_hashed_type) * num_blocks*DIR_ENTRIES);
+    int count = 0;
+    int lbn;
+    for(lbn=0;lbn<num_blocks;lbn++){
+        int bNumber = fileBlock(fs,dir,lbn,0);
+        if(bNumber <= 0)
+            continue;
+        dir_type* directory = (dir_type*)getBlock(fs,bNumber);
+        int dir_idx;
+        for(dir_idx=lbn == 0 ? 2 : 0;dir_idx<DIR_ENTRIES;dir_idx++){
+            if(directory[dir_idx].inode == (unsigned int)-1)
+                continue;
+            names[count].entry = directory[dir_idx];
+            names[count].hash = dirHash(directory[dir_idx].filename);
+            count++;
+        }
+    }
+    qsort(names,count,sizeof(dir_hashed_type),compareHashed);
+
+    //planning the leaves first, so nothing is written when the names don't fit
+    int max_leaves = DIR_ROOT_ENTRIES*DIR_NODE_ENTRIES;
+    int* leaf_start = malloc(sizeof(int) * (max_leaves + 1));
+    int leaves = 0;
+    int i = 0;
+    while(i < count && leaves < max_leaves){
+        leaf_start[leaves++] = i;
+        int end = i + DIR_LEAF_FILL < count ? i + DIR_LEAF_FILL : count;
+        while(end < count && end - i < DIR_ENTRIES && names[end].hash == names[end-1].hash)
+            end++;
+        if(end < count && names[end].hash == names[end-1].hash)
+            break; //a full leaf of one hash
+        i = end;
+    }
+    leaf_start[leaves] = count;
+
+    int num_nodes = leaves > DIR_ROOT_ENTRIES ? (leaves + DIR_NODE_ENTRIES - 1)/DIR_NODE_ENTRIES : 0;
+    int total = 1 + leaves + num_nodes;
+    if(total < num_blocks)
+        total = num_blocks; //blocks past the last leaf stay in the directory, empty
+
+    //with a journal every block is rewritten in the transaction of this call, which must have room for them
+    if(i < count || (journaling(fs) && journalRoom(fs) < total + JOURNAL_CALL_BLOCKS/2)){
+        free(leaf_start);
+        free(names);
+        return V6FS_EDIRFULL;
+    }
+    int status = V6FS_OK;
+    for(lbn=num_blocks;lbn<total && status >= 0;lbn++)
+        status = dirNewBlock(fs,dir,lbn);
+    if(status < 0){
+        free(leaf_start);
+        free(names);
+        return status;
+    }
+
+    //leaves in lbn 1 to leaves, index blocks after them, blocks left over are written empty
+    for(lbn=1;lbn<total - num_nodes;lbn++){
+        int first = lbn <= leaves ? leaf_start[lbn-1] : count;
+        int last = lbn <= leaves ? leaf_start[lbn] : count;
+        dirWriteLeaf(fs,fileBlock(fs,dir,lbn,0),names + first,last - first);
+    }
+
+    char root[BLOCKSIZE];
+    int first = fileBlock(fs,dir,0,0);
+    memcpy(root,getBlock(fs,first),BLOCKSIZE);
+    dir_index_header_type* header = (dir_index_header_type*)(root + 2*sizeof(dir_type));
+    dirIndexInit(header,DIR_ENTRIES - 2);
+    header->num_blocks = total;
+    header->levels = num_nodes > 0;
+
+    int node;
+    for(node=0;node<num_nodes;node++){
+        int node_lbn = total - num_nodes + node;
+        int bNumber = fileBlock(fs,dir,node_lbn,0);
+        dir_index_header_type* node_header = (dir_index_header_type*)getEmptyBlock(fs,bNumber);
+        dirIndexInit(node_header,DIR_ENTRIES);
+        int leaf;
+        for(leaf=node*DIR_NODE_ENTRIES;leaf<leaves && leaf<(node+1)*DIR_NODE_ENTRIES;leaf++)
+            dirIndexInsert(node_header,node_header->count,leaf == 0 ? 0 : names[leaf_start[leaf]].hash,leaf + 1);
+        markBlockDirty(fs,bNumber);
+        dirIndexInsert(header,node,node == 0 ? 0 : names[leaf_start[node*DIR_NODE_ENTRIES]].hash,node_lbn);
+    }
+    if(num_nodes == 0){
+        int leaf;
+        for(leaf=0;leaf<leaves;leaf++)
+            dirIndexInsert(header,leaf,leaf == 0 ? 0 : names[leaf_start[leaf]].hash,leaf + 1);
+        if(leaves == 0)
+            dirIndexInsert(header,0,0,1);
+    }
+    memcpy(getBlock(fs,first),root,BLOCKSIZE);
+    markBlockDirty(fs,first);
+
+    free(leaf_start);
+    free(names);
+    dentryInvalidateParent(fs,dir->iNumber); //entries have moved
+    V6FS_DEBUG(fs,"Directory %d indexed, %d names in %d leaves",dir->iNumber,count,leaves);
+    return V6FS_OK;
+}
+
+/*
+dirIndexSplit() - makes room in the full leaf reached through path
+description: the leaf's names are sorted by hash and the upper half moved to a new leaf, the index entry for it is
+            added to the block above. A full index block is split, or a full root pushed down into a new index block,
+            first and the caller looks the leaf up again
+*/
+int dirIndexSplit(v6fs_t* fs,open_file_type* dir,dir_path_type* path){
+    int first = fileBlock(fs,dir,0,0);
+    dir_index_header_type* root = dirIndex(getBlock(fs,first));
+    int new_lbn = root->num_blocks;
+    int root_count = root->count;
+
+    if(path->levels == 0 && root_count == DIR_ROOT_ENTRIES){
+        //moving the root entries into a new index block
+        int bNumber = fileBlock(fs,dir,new_lbn,1);
+        if(bNumber < 0)
+            return bNumber;
+        char copy[BLOCKSIZE];
+        memcpy(copy,getBlock(fs,first),BLOCKSIZE);
+        root = dirIndex(copy);
+
+        dir_index_header_type* node = (dir_index_header_type*)getEmptyBlock(fs,bNumber);
+        dirIndexInit(node,DIR_ENTRIES);
+        int k;
+        for(k=0;k<root->count;k++)
+            dirIndexInsert(node,k,dirIndexEntry(root,k)->hash,dirIndexEntry(root,k)->lbn);
+        markBlockDirty(fs,bNumber);
+
+        root->count = 0;
+        root->levels = 1;
+        root->num_blocks++;
+        dirIndexInsert(root,0,0,new_lbn);
+        memcpy(getBlock(fs,first),copy,BLOCKSIZE);
+        markBlockDirty(fs,first);
+        return V6FS_OK;
+    }
+
+    if(path->levels == 1){
+        int node_block = fileBlock(fs,dir,path->node_lbn,0);
+        dir_index_header_type* node = (dir_index_header_type*)getBlock(fs,node_block);
+        if(node->count == DIR_NODE_ENTRIES){
+            if(root_count == DIR_ROOT_ENTRIES)
+                return V6FS_EDIRFULL;
+
+            //the upper half of the index block goes to a new one
+            int bNumber = fileBlock(fs,dir,new_lbn,1);
+            if(bNumber < 0)
+                return bNumber;
+            char copy[BLOCKSIZE];
+            memcpy(copy,getBlock(fs,node_block),BLOCKSIZE);
+            node = (dir_index_header_type*)copy;
+            int half = node->count/2;
+
+            dir_index_header_type* upper = (dir_index_header_type*)getEmptyBlock(fs,bNumber);
+            dirIndexInit(upper,DIR_ENTRIES);
+            int k;
+            for(k=half;k<node->count;k++)
+                dirIndexInsert(upper,k - half,dirIndexEntry(node,k)->hash,dirIndexEntry(node,k)->lbn);
+            markBlockDirty(fs,bNumber);
+            unsigned int split_hash = dirIndexEntry(node,half)->hash;
+            node->count = half;
+            memcpy(getBlock(fs,node_block),copy,BLOCKSIZE);
+            markBlockDirty(fs,node_block);
+
+            root = dirIndex(getBlock(fs,first));
+            dirIndexInsert(root,path->k[0] + 1,split_hash,new_lbn);
+            root->num_blocks++;
+            markBlockDirty(fs,first);
+            return V6FS_OK;
+        }
+    }
+
+    //sorting the full leaf by hash and finding the split point nearest the middle between two different hashes
+    int leaf_block = fileBlock(fs,dir,path->leaf_lbn,0);
+    dir_hashed_type names[DIR_ENTRIES];
+    dir_type* directory = (dir_type*)getBlock(fs,leaf_block);
+    int i;
+    for(i=0;i<DIR_ENTRIES;i++){
+        names[i].entry = directory[i];
+        names[i].hash = dirHash(directory[i].filename);
+    }
+    qsort(names,DIR_ENTRIES,sizeof(dir_hashed_type),compareHashed);
+
+    int split = -1;
+    int d;
+    for(d=0;d<DIR_ENTRIES/2 && split == -1;d++){
+        if(names[DIR_ENTRIES/2 + d].hash != names[DIR_ENTRIES/2 + d - 1].hash)
+            split = DIR_ENTRIES/2 + d;
+        else if(names[DIR_ENTRIES/2 - d].hash != names[DIR_ENTRIES/2 - d - 1].hash)
+            split = DIR_ENTRIES/2 - d;
+    }
+    if(split == -1)
+        return V6FS_EDIRFULL;
+
+    int bNumber = dirNewBlock(fs,dir,new_lbn);
+    if(bNumber < 0)
+        return bNumber;
+    dirWriteLeaf(fs,leaf_block,names,split);
+    dirWriteLeaf(fs,bNumber,names + split,DIR_ENTRIES - split);
+
+    if(path->levels == 1){
+        int node_block = fileBlock(fs,dir,path->node_lbn,0);
+        dirIndexInsert((dir_index_header_type*)getBlock(fs,node_block),path->k[1] + 1,names[split].hash,new_lbn);
+        markBlockDirty(fs,node_block);
+    }
+    root = dirIndex(getBlock(fs,first));
+    if(path->levels == 0)
+        dirIndexInsert(root,path->k[0] + 1,names[split].hash,new_lbn);
+    root->num_blocks++;
+    markBlockDirty(fs,first);
+
+    dentryInvalidateParent(fs,dir->iNumber); //entries have moved
+    return V6FS_OK;
+}
+
+//finding a free entry in an indexed directory for a name hashing to hash, returns its byte address
+long long dirIndexFreeSlot(v6fs_t* fs,open_file_type* dir,unsigned int hash){
+    while(1){
+        dir_path_type path;
+        int leaf = dirIndexLeaf(fs,dir,hash,&path);
+        if(leaf <= 0)
+            return V6FS_EIO;
+
+        int free_slot = -1;
+        fs->dir_match((dir_type*)getBlock(fs,leaf),dir_no_name,&free_slot);
+        if(free_slot != -1)
+            return (long long)BLOCKSIZE*leaf + 32*free_slot;
+
+        int status = dirIndexSplit(fs,dir,&path);
+        if(status < 0)
+            return status;
+    }
+}
+
+/*
+dirFreeSlot() - finds a free entry in the directory iNumber where name can be added
+description: returns the byte address of the entry, after adding a block to the directory if there was no free
+            one. The entry is filled by dirSetEntry(), nothing else in the directory may change in between
+*/
+long long dirFreeSlot(v6fs_t* fs,int iNumber,char* name){
+    open_file_type dir;
+    openFile(fs,&dir,iNumber);
+    int first = fileBlock(fs,&dir,0,0);
+    if(first <= 0)
+        return V6FS_ENOTDIR;
+
+    //the free entry dirLookup() came across while not finding this name, if nothing took it since
+    char key[28];
+    dirKey(key,name);
+    long long hint = fs->free_hint_dir == iNumber && memcmp(fs->free_hint_name,key,28) == 0 ? fs->free_hint_addr : -1;
+    fs->free_hint_dir = 0;
+    if(hint != -1 && ((dir_type*)(getBlock(fs,hint/BLOCKSIZE) + hint%BLOCKSIZE))->inode == (unsigned int)-1)
+        return hint;
+
+    long long addr = -1;
+    if(dirIndex(getBlock(fs,first)) != NULL){
+        addr = dirIndexFreeSlot(fs,&dir,dirHash(name));
+        closeFile(fs,&dir);
+        return addr;
+    }
+
+    int num_blocks = dirNumBlocks(fs,&dir);
+    int free_lbn = -1; //first unmapped block of a small directory
+    int lbn;
+    for(lbn=0;lbn<num_blocks && addr == -1;lbn++){
+        int bNumber = fileBlock(fs,&dir,lbn,0);
+        if(bNumber <= 0){
+            if(free_lbn == -1)
+                free_lbn = lbn;
+            continue;
+        }
+        int free_slot = -1;
+        fs->dir_match((dir_type*)getBlock(fs,bNumber),dir_no_name,&free_slot);
+        if(free_slot != -1)
+            addr = (long long)BLOCKSIZE*bNumber + 32*free_slot;
+    }
+    if(addr != -1)
+        return addr;
+
+    //only a directory without holes is indexed, its blocks are reused as leaves
+    if(fs->dir_index && free_lbn == -1 && dirMakeIndex(fs,&dir) == V6FS_OK){
+        addr = dirIndexFreeSlot(fs,&dir,dirHash(name));
+    }else{
+        int bNumber = dirNewBlock(fs,&dir,free_lbn != -1 ? free_lbn : num_blocks);
+        addr = bNumber < 0 ? bNumber : (long long)BLOCKSIZE*bNumber;
+    }
+    closeFile(fs,&dir);
+    return addr;
+}
+
+//writing the entry for entry_inode at the address dirFreeSlot() returned and counting it in the directory size
+void dirSetEntry(v6fs_t* fs,int iNumber,long long addr,char* name,int entry_inode){
+    dir_type* entry = (dir_type*)(getBlock(fs,addr/BLOCKSIZE) + addr%BLOCKSIZE);
+    entry->inode = entry_inode;
+    memset(entry->filename,'\0',sizeof(entry->filename));
+    memcpy(entry->filename,name,strnlen(name,28));
+    markBlockDirty(fs,addr/BLOCKSIZE);
+
+    icache_entry_type* dir = inodeGet(fs,iNumber);
+    long long size = ((long long)dir->size0 << 32 | dir->size1) + 32;
+    dir->size0 = (unsigned int)(size >> 32);
+    dir->size1 = (unsigned int)size;
+    dir->dirty = 1;
+    inodePut(fs,dir);
+}
+
+//copying the entries in use of the directory iNumber, . and .. excluded, into a new array. Returns their number
+int dirEntries(v6fs_t* fs,int iNumber,dir_type** entries){
+    open_file_type dir;
+    openFile(fs,&dir,iNumber);
+    int num_blocks = dirNumBlocks(fs,&dir);
+    *entries = malloc(sizeof(dir_type) * (num_blocks*DIR_ENTRIES + 1));
+
+    int count = 0;
+    int lbn;
+    for(lbn=0;lbn<num_blocks;lbn++){
+        int bNumber = fileBlock(fs,&dir,lbn,0);
+        if(bNumber <= 0)
+            continue;
+        dir_type* directory = (dir_type*)getBlock(fs,bNumber);
+        int dir_idx;
+        for(dir_idx=lbn == 0 ? 2 : 0;dir_idx<DIR_ENTRIES;dir_idx++){
+            //index slots name inode 0
+            if(directory[dir_idx].inode == (unsigned int)-1 || directory[dir_idx].inode == 0)
+                continue;
+            (*entries)[count++] = directory[dir_idx];
+        }
+    }
+    return count;
+}
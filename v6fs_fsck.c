@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "v6fs.h"
+
+/*
+v6fs_fsck - checks the consistency of an image
+usage: v6fs_fsck [-r] [-j threads] [-m] [-q] image
+    -r  repairs what can be repaired
+    -j  threads scanning the inode table, one per online CPU by default
+    -m  opens the image with V6FS_MMAP
+    -q  prints the summary only, not every problem
+
+a journaled image is replayed by opening it, before it is checked. The summary line is
+    fsck inodes=<n> directories=<n> blocks_used=<n> blocks_free=<n> problems=<n> repaired=<n> secs=<s>
+the exit status is 0 for a consistent image, 1 when the repair left none of the problems found and 4 otherwise
+*/
+
+int main(int argc,char* argv[]){
+    int flags = 0;
+    int open_flags = 0;
+    int num_threads = 0;
+    int quiet = 0;
+    char* image = NULL;
+
+    int i;
+    for(i=1;i<argc;i++){
+        if(strcmp(argv[i],"-r") == 0){
+            flags = V6FS_FSCK_REPAIR;
+        }else if(strcmp(argv[i],"-j") == 0 && i+1 < argc){
+            num_threads = atoi(argv[++i]);
+        }else if(strcmp(argv[i],"-m") == 0){
+            open_flags = V6FS_MMAP;
+        }else if(strcmp(argv[i],"-q") == 0){
+            quiet = 1;
+        }else if(argv[i][0] != '-' && image == NULL){
+            image = argv[i];
+        }else{
+            image = NULL;
+            break;
+        }
+    }
+    if(image == NULL){
+        fprintf(stderr,"Usage: %s [-r] [-j threads] [-m] [-q] image\n",argv[0]);
+        return 8;
+    }
+
+    //v6fs_open() creates missing images, a typo must not produce an empty one
+    struct stat st;
+    if(stat(image,&st) == -1){
+        fprintf(stderr,"Cannot open %s\n",image);
+        return 8;
+    }
+
+    int err;
+    v6fs_t* fs = v6fs_open(image,open_flags,&err);
+    if(fs == NULL){
+        fprintf(stderr,"Cannot open %s: %s\n",image,v6fs_strerror(err));
+        return 8;
+    }
+
+    v6fs_fsck_t report;
+    int status = v6fs_fsck(fs,flags,num_threads,quiet ? NULL : stdout,&report);
+    if(status < 0){
+        fprintf(stderr,"%s: %s\n",image,v6fs_strerror(status));
+        v6fs_close(fs);
+        return 8;
+    }
+
+    v6fs_stats_t stats;
+    v6fs_get_stats(fs,&stats);
+    printf("fsck inodes=%lld directories=%lld blocks_used=%lld blocks_free=%lld problems=%lld repaired=%lld secs=%.6f\n",
+        report.inodes,report.directories,report.blocks_used,report.blocks_free,report.problems,report.repaired,
+        stats.op_usecs[V6FS_OP_FSCK]/1e6);
+
+    //what the repair left behind is found by checking again
+    int left = status;
+    if(status > 0 && (flags & V6FS_FSCK_REPAIR))
+        left = v6fs_fsck(fs,0,num_threads,NULL,NULL);
+    v6fs_close(fs);
+
+    if(status == 0)
+        return 0;
+    return left == 0 ? 1 : 4;
+}
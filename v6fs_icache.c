@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include "v6fs_internal.h"
+
+/*
+Inode cache
+inodes are read from their table block once and then used and changed in memory. A changed inode is only written
+back to its table block by icacheFlush() at the sync points, or when its entry is reused, and the flush writes the
+dirty inodes of one table block together so the block is fetched and marked dirty once for all of them. Code that
+changes the inode table blocks directly (formatting, fsck repairs) calls icacheDestroy() around it
+*/
+
+//block holding inode iNumber in the inode table and its offset there
+int inodeBlock(int iNumber){
+    return 2 + (iNumber-1)/16;
+}
+
+int inodeOffset(int iNumber){
+    return ((iNumber-1)%16)*INODESIZE;
+}
+
+void icacheLruUnlink(v6fs_t* fs,icache_entry_type* entry){
+    if(entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        fs->icache_lru_head = entry->lru_next;
+
+    if(entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        fs->icache_lru_tail = entry->lru_prev;
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+void icacheLruPushFront(v6fs_t* fs,icache_entry_type* entry){
+    entry->lru_prev = NULL;
+    entry->lru_next = fs->icache_lru_head;
+    if(fs->icache_lru_head != NULL)
+        fs->icache_lru_head->lru_prev = entry;
+    fs->icache_lru_head = entry;
+    if(fs->icache_lru_tail == NULL)
+        fs->icache_lru_tail = entry;
+}
+
+void icacheHashRemove(v6fs_t* fs,icache_entry_type* entry){
+    icache_entry_type** link = &fs->icache_hash[entry->iNumber & (ICACHE_BUCKETS-1)];
+    while(*link != entry)
+        link = &(*link)->hash_next;
+    *link = entry->hash_next;
+    entry->hash_next = NULL;
+}
+
+//copying between the on-disk inode and the split layout of an entry
+void icacheLoad(icache_entry_type* entry,inode_type* inode){
+    entry->flags = inode->flags;
+    entry->nlinks = inode->nlinks;
+    entry->size0 = inode->size0;
+    entry->size1 = inode->size1;
+    memcpy(entry->addr,inode->addr,sizeof(entry->addr));
+    entry->uid = inode->uid;
+    entry->gid = inode->gid;
+    entry->actime = inode->actime;
+    entry->modtime = inode->modtime;
+}
+
+void icacheStore(icache_entry_type* entry,inode_type* inode){
+    inode->flags = entry->flags;
+    inode->nlinks = entry->nlinks;
+    inode->size0 = entry->size0;
+    inode->size1 = entry->size1;
+    memcpy(inode->addr,entry->addr,sizeof(inode->addr));
+    inode->uid = entry->uid;
+    inode->gid = entry->gid;
+    inode->actime = entry->actime;
+    inode->modtime = entry->modtime;
+}
+
+void icacheWriteBack(v6fs_t* fs,icache_entry_type* entry){
+    int bNumber = inodeBlock(entry->iNumber);
+    icacheStore(entry,(inode_type*)(getBlock(fs,bNumber) + inodeOffset(entry->iNumber)));
+    markBlockDirty(fs,bNumber);
+    entry->dirty = 0;
+}
+
+/*
+inodeGet() - returns the cached inode iNumber, reading it from the inode table on a miss
+description: the entry stays valid until the matching inodePut(fs), set dirty to have changes written back
+*/
+icache_entry_type* inodeGet(v6fs_t* fs,int iNumber){
+    if(fs->icache_hash == NULL){
+        fs->icache_hash = calloc(ICACHE_BUCKETS,sizeof(icache_entry_type*));
+        fs->icache_entries = aligned_alloc(64,sizeof(icache_entry_type) * ICACHE_CAPACITY);
+        fs->icache_count = 0;
+    }
+
+    icache_entry_type* entry = fs->icache_hash[iNumber & (ICACHE_BUCKETS-1)];
+    while(entry != NULL && entry->iNumber != iNumber)
+        entry = entry->hash_next;
+
+    if(entry != NULL){
+        V6FS_STAT(fs,inode_cache_hits,1);
+        icacheLruUnlink(fs,entry);
+    }else{
+        V6FS_STAT(fs,inode_cache_misses,1);
+        if(fs->icache_count < ICACHE_CAPACITY){
+            entry = &fs->icache_entries[fs->icache_count++];
+        }else{
+            entry = fs->icache_lru_tail;
+            while(entry->refs > 0)
+                entry = entry->lru_prev; //a few entries at most are referenced at once
+            icacheLruUnlink(fs,entry);
+            icacheHashRemove(fs,entry);
+            if(entry->dirty)
+                icacheWriteBack(fs,entry);
+        }
+
+        entry->iNumber = iNumber;
+        entry->refs = 0;
+        entry->dirty = 0;
+        icacheLoad(entry,(inode_type*)(getBlock(fs,inodeBlock(iNumber)) + inodeOffset(iNumber)));
+        entry->hash_next = fs->icache_hash[iNumber & (ICACHE_BUCKETS-1)];
+        fs->icache_hash[iNumber & (ICACHE_BUCKETS-1)] = entry;
+    }
+
+    icacheLruPushFront(fs,entry);
+    entry->refs++;
+    return entry;
+}
+
+void inodePut(v6fs_t* fs,icache_entry_type* entry){
+    (void)fs;
+    entry->refs--;
+}
+
+int compareICacheEntries(const void* a,const void* b){
+    return (*(icache_entry_type**)a)->iNumber - (*(icache_entry_type**)b)->iNumber;
+}
+
+//writing the dirty inodes back in inode order, so the inodes of one table block go out with one block access
+void icacheFlush(v6fs_t* fs){
+    if(fs->icache_hash == NULL)
+        return;
+
+    icache_entry_type** dirty = malloc(sizeof(icache_entry_type*) * (fs->icache_count+1));
+    int num_dirty = 0;
+    int i;
+    for(i=0;i<fs->icache_count;i++){
+        if(fs->icache_entries[i].dirty)
+            dirty[num_dirty++] = &fs->icache_entries[i];
+    }
+    qsort(dirty,num_dirty,sizeof(icache_entry_type*),compareICacheEntries);
+
+    i = 0;
+    while(i < num_dirty){
+        int bNumber = inodeBlock(dirty[i]->iNumber);
+        char* block = getBlock(fs,bNumber);
+        while(i < num_dirty && inodeBlock(dirty[i]->iNumber) == bNumber){
+            icacheStore(dirty[i],(inode_type*)(block + inodeOffset(dirty[i]->iNumber)));
+            dirty[i]->dirty = 0;
+            i++;
+        }
+        markBlockDirty(fs,bNumber);
+    }
+    free(dirty);
+}
+
+//flushing and dropping every cached inode
+void icacheDestroy(v6fs_t* fs){
+    if(fs->icache_hash == NULL)
+        return;
+    icacheFlush(fs);
+    free(fs->icache_hash);
+    free(fs->icache_entries);
+    fs->icache_hash = NULL;
+    fs->icache_entries = NULL;
+    fs->icache_lru_head = NULL;
+    fs->icache_lru_tail = NULL;
+    fs->icache_count = 0;
+}
+
+//This method will read Inode from file system
+void readInodeFromFS(v6fs_t* fs,int iNumber,inode_type* output){
+    icache_entry_type* entry = inodeGet(fs,iNumber);
+    icacheStore(entry,output);
+    inodePut(fs,entry);
+}
+
+//This methof will write Inode to file system, num_bytes from the start of the inode
+void writeInodeToFS(v6fs_t* fs,int iNumber,void * input, int num_bytes){
+    icache_entry_type* entry = inodeGet(fs,iNumber);
+    inode_type inode;
+    icacheStore(entry,&inode);
+    memcpy(&inode,input,num_bytes);
+    icacheLoad(entry,&inode);
+    entry->dirty = 1;
+    inodePut(fs,entry);
+}
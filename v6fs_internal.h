@@ -0,0 +1,472 @@
+#ifndef V6FS_INTERNAL_H
+#define V6FS_INTERNAL_H
+
+/*
+on-disk structures and the state behind a v6fs_t handle, shared by the library sources only
+*/
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "v6fs.h"
+
+//superblock struct
+typedef struct {
+    unsigned int isize;
+    unsigned int fsize;
+    unsigned int nfree;
+    unsigned int free[251];
+    char flock;
+    char ilock;
+    char fmod;
+    unsigned int time;
+} superblock_type;
+
+//Inode Struct
+typedef struct {
+    unsigned short flags;
+    unsigned short nlinks;
+    unsigned int uid;
+    unsigned int gid;
+    unsigned int size0;
+    unsigned int size1;
+    unsigned int addr[9];
+    unsigned int actime;
+    unsigned int modtime;
+} inode_type;
+
+typedef struct {
+    unsigned int inode;
+    char filename[28];
+} dir_type;
+
+//Defining size of inode and block as constants for better readibility
+#define INODESIZE 64
+#define BLOCKSIZE 1024
+
+//flags bit for large files, and the block map layout used by them
+#define LARGEFILE (1<<12)
+#define NUM_INDIRECT 7 //addr[0..6] are indirect, addr[7..8] double indirect
+#define PTRS_PER_BLOCK 256
+#define MAX_FILE_BLOCKS (NUM_INDIRECT*PTRS_PER_BLOCK + 2*PTRS_PER_BLOCK*PTRS_PER_BLOCK)
+
+//size of the buffer cpin and cpout stream file data through
+#define STREAM_BUFSIZE (1024*1024)
+
+/*
+metadata journal, a region of journal_blocks blocks at the end of the image described by a header in the boot block.
+A transaction is one or more descriptor blocks, each followed by the images of the blocks it lists, and a commit block
+*/
+#define JOURNAL_MAGIC 0x4a364656 //"V6FJ"
+#define JOURNAL_DESC_MAGIC 0x4353454a
+#define JOURNAL_COMMIT_MAGIC 0x4d4d434a
+#define JOURNAL_DESC_BLOCKS 253 //block numbers listed by one descriptor
+#define JOURNAL_MIN_BLOCKS 16
+#define JOURNAL_CALL_BLOCKS 32 //blocks a single call may add to a transaction, a call never spans two
+
+typedef struct {
+    unsigned int magic;
+    unsigned int start; //first block of the journal region
+    unsigned int num_blocks;
+    unsigned int seq; //transactions from this sequence number on, stored from the start of the region, are replayed
+} journal_header_type;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int seq;
+    unsigned int count;
+    unsigned int blocks[JOURNAL_DESC_BLOCKS];
+} journal_desc_type;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int seq;
+    unsigned int count; //blocks in the transaction
+    unsigned int checksum; //of the block numbers and images
+} journal_commit_type;
+
+/*
+hashed directory index, htree style. The root is kept in the first block of a directory right after . and .., and
+maps ranges of name hashes to leaf blocks holding the names in those ranges, either directly or through one level
+of index blocks. Index slots look like used entries naming inode 0 with an empty name, so a linear scan of the
+directory skips them and still finds every name in the leaves
+*/
+#define DIR_INDEX_MAGIC 0x58444e49 //"INDX"
+#define DIR_ROOT_ENTRIES 87 //3 per slot in the 29 slots after . .. and the header
+#define DIR_NODE_ENTRIES 93 //3 per slot in the 31 slots after the header
+#define DIR_LEAF_FILL 24 //entries per leaf when a directory is converted, leaving room to grow before splitting
+
+typedef struct {
+    unsigned int hash; //lowest hash of the names below this entry
+    unsigned int lbn; //logical block of the directory
+} dir_index_entry_type;
+
+typedef struct {
+    unsigned int inode; //always 0
+    unsigned int zero; //empty name
+    dir_index_entry_type entries[3];
+} dir_index_slot_type;
+
+//first slot of the root and of every index block
+typedef struct {
+    unsigned int inode;
+    unsigned int zero;
+    unsigned int magic;
+    unsigned short count; //index entries, in the slots after this one
+    unsigned short levels; //root only, index block levels below the root, 0 or 1
+    unsigned int num_blocks; //root only, logical blocks of the directory
+    unsigned int unused[3];
+} dir_index_header_type;
+
+//searches the 32 entries of a directory block for the 28 byte key, see dirMatchSelect(). Returns the matching entry
+//or -1, and sets free_slot to the first free entry before it when free_slot is -1
+typedef int (*dir_match_type)(dir_type* entries,char* key,int* free_slot);
+
+//returns 1 when the BLOCKSIZE bytes at block are all zeros, see zeroCheckSelect()
+typedef int (*zero_check_type)(char* block);
+
+//dentry cache buckets, DENTRY_BUCKETS must be a power of two
+#define DENTRY_BUCKETS 4096
+#define DENTRY_CAPACITY 16384
+
+//block cache entry, linked into an LRU list and into a hash chain keyed by block number
+typedef struct cache_entry {
+    int bNumber;
+    int dirty;
+    struct cache_entry *lru_prev;
+    struct cache_entry *lru_next;
+    struct cache_entry *hash_next;
+    char data[BLOCKSIZE];
+} cache_entry_type;
+
+/*
+inode cache entry, the fields path walks and block mapping read come first and fill one 64 byte line together with
+the hash link, the rest of the inode and the LRU links follow on the next one
+*/
+#define ICACHE_CAPACITY 4096
+#define ICACHE_BUCKETS 8192
+
+typedef struct icache_entry {
+    unsigned short flags;
+    unsigned short nlinks;
+    unsigned int size0;
+    unsigned int size1;
+    unsigned int addr[9];
+    int iNumber;
+    short refs; //inodeGet() calls not yet matched by inodePut(), a referenced entry is never evicted
+    short dirty; //changed since it was written to its inode table block
+    struct icache_entry *hash_next;
+
+    unsigned int uid;
+    unsigned int gid;
+    unsigned int actime;
+    unsigned int modtime;
+    struct icache_entry *lru_prev;
+    struct icache_entry *lru_next;
+} __attribute__((aligned(64))) icache_entry_type;
+
+/*
+per open file block map state
+a large file keeps indirect blocks in addr[0..6] and double indirect blocks in addr[7..8]. The indirect and
+double indirect block last used are held here so sequential access reads each of them once
+*/
+typedef struct {
+    int iNumber;
+    inode_type inode;
+    int ind_block; //block number whose entries are in ind, 0 when nothing is loaded
+    int ind_dirty; //MAP_DIRTY and MAP_NEW bits
+    unsigned int ind[256];
+    int dind_block;
+    int dind_dirty;
+    unsigned int dind[256];
+} open_file_type;
+
+#define MAP_DIRTY 1
+#define MAP_NEW 2 //allocated while loaded, nothing committed points to it yet
+
+//blocks lbn to lbn+len-1 of a file, stored in the consecutive blocks starting at bNumber
+typedef struct {
+    int lbn;
+    int bNumber;
+    int len;
+} block_run_type;
+
+//a copy of in_len bytes at in_off in in_fd to out_off in out_fd, padded with zeros to out_len bytes
+typedef struct {
+    int in_fd;
+    off_t in_off;
+    long long in_len;
+    int out_fd;
+    off_t out_off;
+    long long out_len;
+} copy_segment_type;
+
+//file removed by rm with V6FS_FREE_LAZY whose blocks are not freed yet, addr[next..8] are left
+typedef struct {
+    unsigned int addr[9];
+    int flags;
+    int next;
+} reclaim_type;
+
+#define RECLAIM_BATCH 4096 //queued blocks freed at one sync point
+#define SCRUB_CHUNK 64 //blocks of zeros written at once over a freed run
+
+//io_uring instance with its in-flight buffers, defined in v6fs_uring.c
+typedef struct uring uring_type;
+
+//dentry cache entry, chained in dentry_hash by (parent, name)
+typedef struct dentry {
+    int parent;
+    char name[29];
+    int inode;
+    long long addr;
+    struct dentry *next;
+} dentry_type;
+
+//everything known about one open image
+struct v6fs {
+    pthread_mutex_t lock; //held for the duration of every public call
+
+    int fd;
+    superblock_type superBlock;
+    inode_type root_inode;
+    int curr_inode;
+    long long addr_dir; //byte address of the directory entry found by the last path_to_inode()
+    int addr_inode; //inode of the directory holding that entry
+
+    //block cache state, lru_head is the most recently used block and lru_tail the next one to be evicted
+    cache_entry_type **cache_hash;
+    cache_entry_type *lru_head;
+    cache_entry_type *lru_tail;
+    int cache_hash_size;
+    int cache_count;
+    int cache_capacity; //number of blocks held in memory, with a journal more while the dirty ones don't fit
+    int cache_dirty;
+
+    //inode cache state, entries are taken from icache_entries until ICACHE_CAPACITY are in use, then the least
+    //recently used one without references is reused
+    icache_entry_type* icache_entries;
+    icache_entry_type** icache_hash;
+    icache_entry_type* icache_lru_head;
+    icache_entry_type* icache_lru_tail;
+    int icache_count;
+
+    //mmap mode state, when image_map is set blocks are accessed directly in the mapping instead of the block cache
+    int mmap_mode;
+    char* image_map;
+    size_t image_map_size;
+
+    //in-memory free inode bitmap, bit (i-1) is set when inode i is allocated. Built once at open/format
+    unsigned long long* inode_bitmap;
+    int inode_bitmap_words;
+    int inode_hint_word; //no free inode exists in the words before this one
+    int num_free_inodes;
+
+    dentry_type* dentry_hash[DENTRY_BUCKETS];
+    int dentry_count;
+
+    //extent allocation mode state, block_bitmap has a bit set for every free block while extent_alloc is on
+    int extent_alloc;
+    unsigned long long* block_bitmap;
+    int block_bitmap_words;
+    int free_chain_dirty; //the on-disk free chain no longer matches block_bitmap
+    int alloc_cursor; //extent searches start here so consecutive allocations move forward through the image
+    int res_next; //blocks res_next to res_end-1 are reserved for the file being written
+    int res_end;
+    int res_want; //blocks still wanted by the reservation beyond res_end
+
+    dir_match_type dir_match; //the block matching kernel the CPU supports
+    zero_check_type zero_check; //the zero block check the CPU supports
+    int free_hint_dir; //directory the last dirLookup() missing free_hint_name in saw the free entry at free_hint_addr
+    long long free_hint_addr;
+    char free_hint_name[28];
+    int dir_index; //a full directory is converted to a hashed index instead of growing another linear block
+
+    //freed blocks, punch_bitmap has a bit set for every freed block whose contents punchFlush(fs) has yet to drop.
+    //The files queued by a lazy rm are reclaim[reclaim_head..num_reclaim-1], those before reclaim_ready are committed.
+    //With a journal the blocks freed since the last commit are held in deferred until it
+    int free_mode; //V6FS_FREE_PUNCH, V6FS_FREE_ZERO or V6FS_FREE_KEEP
+    int lazy_free;
+    unsigned long long* punch_bitmap;
+    int punch_bitmap_words;
+    int num_punch;
+    int* deferred;
+    int num_deferred;
+    int deferred_capacity;
+    int frees_waiting; //deferred holds blocks of removed files, not only list mode chain blocks
+    reclaim_type* reclaim;
+    int reclaim_head;
+    int reclaim_ready;
+    int num_reclaim;
+    int reclaim_capacity;
+
+    //data block transfers go through ring when io_backend is V6FS_IO_URING, the ring is only used under the lock
+    int io_backend;
+    uring_type* ring;
+
+    //metadata journal, transactions are appended at journal_pos and the region is emptied by journalCheckpoint(fs)
+    int journal_start;
+    int journal_blocks; //0 when the image has no journal
+    int journal_pos; //relative to journal_start
+    unsigned int journal_seq; //sequence number of the next transaction
+    unsigned int journal_base_seq; //sequence number of the transaction at the start of the region
+    unsigned long long* journal_map; //blocks logged since the last checkpoint, which replay would overwrite
+    int journal_format_blocks; //journal size reserved by the next initfs
+    int journal_unsynced; //map or bulk copied data blocks written straight to the image since the last commit
+
+    //bulk copies in progress, their workers copy file data without the lock. bulk_done is broadcast when one ends or
+    //a file is unpinned. The files listed by a bulk export are pinned, once per listing, until their copy is done
+    int bulk_calls;
+    pthread_cond_t bulk_done;
+    int* pinned;
+    int num_pinned;
+    int pinned_capacity;
+
+    //counters are updated with V6FS_STAT() since bulk copy workers count their I/O without holding the lock
+    v6fs_stats_t stats;
+
+    //messages up to log_level are written to log_out
+    int log_level;
+    FILE* log_out;
+
+    //the superblock is only written at sync points, every superblock_sync_interval calls (0 means only on sync and close)
+    int superblock_sync_interval;
+    int commands_since_sync;
+};
+
+//logging, debug messages are not even formatted unless the debug level is on
+void v6fsLog(v6fs_t* fs,int level,const char* format,...);
+#define V6FS_DEBUG(fs,...) do{ if((fs)->log_level >= V6FS_LOG_DEBUG) v6fsLog(fs,V6FS_LOG_DEBUG,__VA_ARGS__); }while(0)
+
+//statistics, statsClock() is in microseconds
+#define V6FS_STAT(fs,field,n) __atomic_fetch_add(&(fs)->stats.field,(long long)(n),__ATOMIC_RELAXED)
+long long statsClock();
+void statsRecord(v6fs_t* fs,int op,long long start);
+
+//block cache
+void cacheWriteBack(v6fs_t* fs,cache_entry_type* entry);
+char* getBlock(v6fs_t* fs,int bNumber);
+char* getEmptyBlock(v6fs_t* fs,int bNumber);
+void markBlockDirty(v6fs_t* fs,int bNumber);
+void flushBlock(v6fs_t* fs,int bNumber);
+void cacheDiscard(v6fs_t* fs,int bNumber);
+void cacheTrim(v6fs_t* fs);
+void cacheDestroy(v6fs_t* fs);
+void syncFS(v6fs_t* fs);
+void setCacheSize(v6fs_t* fs,int num_blocks);
+int mapImage(v6fs_t* fs,int num_blocks);
+void unmapImage(v6fs_t* fs);
+void writeBlockToFS(v6fs_t* fs,int bNumber,void *input, int num_bytes);
+
+//inode cache
+icache_entry_type* inodeGet(v6fs_t* fs,int iNumber);
+void inodePut(v6fs_t* fs,icache_entry_type* entry);
+void icacheFlush(v6fs_t* fs);
+void icacheDestroy(v6fs_t* fs);
+
+//inodes and superblock
+void writeInodeToFS(v6fs_t* fs,int iNumber,void * input, int num_bytes);
+void readInodeFromFS(v6fs_t* fs,int iNumber,inode_type* output);
+void flushSuperBlock(v6fs_t* fs);
+void buildInodeBitmap(v6fs_t* fs);
+void markInodeAllocated(v6fs_t* fs,int iNumber);
+void releaseInode(v6fs_t* fs,int iNumber);
+int findUnallocatedInode(v6fs_t* fs);
+
+//dentry cache
+int dentryLookup(v6fs_t* fs,int parent,char* name);
+void dentryClear(v6fs_t* fs);
+void dentryInsert(v6fs_t* fs,int parent,char* name,int inode,long long addr);
+void dentryInvalidate(v6fs_t* fs,int parent,char* name);
+void dentryInvalidateParent(v6fs_t* fs,int parent);
+
+//block allocation
+int getFreeBlock(v6fs_t* fs);
+void addFreeBlock(v6fs_t* fs,int bNumber);
+void putFreeBlock(v6fs_t* fs,int bNumber);
+void allocBlockBitmap(v6fs_t* fs,int totalBlocks);
+void buildBlockBitmap(v6fs_t* fs);
+void writeFreeChain(v6fs_t* fs);
+void syncFreeChain(v6fs_t* fs);
+int freeChainBlocks(v6fs_t* fs);
+void reserveBlocks(v6fs_t* fs,int num_blocks);
+void releaseReservation(v6fs_t* fs);
+void setAllocMode(v6fs_t* fs,int mode);
+int nextBit(unsigned long long* bits,int num_words,int bit,int value);
+
+//freed blocks
+void scrubBlock(v6fs_t* fs,int bNumber);
+void punchCancel(v6fs_t* fs,int bNumber);
+void punchFlush(v6fs_t* fs);
+void deferFree(v6fs_t* fs,int bNumber);
+void releaseDeferred(v6fs_t* fs);
+void reclaimQueue(v6fs_t* fs,inode_type* inode);
+void reclaimCommitted(v6fs_t* fs);
+int reclaimRun(v6fs_t* fs,int budget);
+void reclaimDrain(v6fs_t* fs);
+void reclaimDestroy(v6fs_t* fs);
+
+//images
+int openImage(v6fs_t* fs,const char* fileName,int flags);
+void endCall(v6fs_t* fs);
+int copyPath(char* dst,const char* src);
+int initfs(v6fs_t* fs,int totalBlocks,int totalInodeBlocks);
+
+//metadata journal
+int journaling(v6fs_t* fs);
+void journalFormat(v6fs_t* fs,int num_blocks);
+int journalOpen(v6fs_t* fs);
+int journalCommit(v6fs_t* fs);
+int journalMinBlocks(int totalBlocks);
+int journalRoom(v6fs_t* fs);
+void journalReserve(v6fs_t* fs,int num_blocks);
+int journalCheckpoint(v6fs_t* fs);
+int journalHolds(v6fs_t* fs,int bNumber);
+void journalClose(v6fs_t* fs);
+
+//io_uring backend
+uring_type* uringCreate();
+void uringDestroy(uring_type* ring);
+int uringCopy(uring_type* ring,copy_segment_type* segs,int num_segs);
+
+//files and directories
+long long getFileSize(inode_type* inode);
+void setFileSize(inode_type* inode,long long size);
+void openFile(v6fs_t* fs,open_file_type* file,int iNumber);
+void closeFile(v6fs_t* fs,open_file_type* file);
+int fileBlock(v6fs_t* fs,open_file_type* file,int lbn,int alloc);
+int freeAddr(v6fs_t* fs,int bNumber,int flags,int i);
+void freeFileBlocks(v6fs_t* fs,inode_type* inode);
+dir_match_type dirMatchSelect();
+void dirKey(char* key,char* name);
+unsigned int dirHash(char* name);
+dir_index_header_type* dirIndex(char* block);
+dir_index_entry_type* dirIndexEntry(dir_index_header_type* header,int k);
+int dirIndexSearch(dir_index_header_type* header,unsigned int hash);
+int dirLookup(v6fs_t* fs,int iNumber,char* name);
+long long dirFreeSlot(v6fs_t* fs,int iNumber,char* name);
+void dirSetEntry(v6fs_t* fs,int iNumber,long long addr,char* name,int entry_inode);
+int dirEntries(v6fs_t* fs,int iNumber,dir_type** entries);
+int allocateFreeBlockToDir(v6fs_t* fs,int blockNumber, int parentInode,int firstBlock,int free_inode);
+int allocateNewInodeToDir(v6fs_t* fs,int inode_num, int parentInode);
+int path_to_inode(v6fs_t* fs,char* ppath,int curr_inode_temp);
+int process_path(v6fs_t* fs,char* path,char* last_dir);
+int nameExists(v6fs_t* fs,int inode_curr,char* name);
+int makedir(v6fs_t* fs,char* dir_name,int inode_curr);
+void removeFile(v6fs_t* fs,int iNumber,inode_type* inode);
+int rm(v6fs_t* fs,char* path);
+int newFileInode(v6fs_t* fs,long long size);
+int linkFile(v6fs_t* fs,char* intFile,int inode_curr,int iNumber);
+zero_check_type zeroCheckSelect();
+int fileDataMap(v6fs_t* fs,int fde,struct stat* st,unsigned long long** map);
+int streamIn(v6fs_t* fs,int fde,struct stat* st,int iNumber,char* buf);
+int fileRuns(v6fs_t* fs,int iNumber,int alloc,unsigned long long* data_map,int lbn_start,int lbn_end,block_run_type** runs);
+int copyRunsIn(v6fs_t* fs,int fde,long long size,block_run_type* runs,int num_runs,int lbn_start,int lbn_end,uring_type* ring,char* buf);
+int cpin(v6fs_t* fs,char* extFile,char* intFile,int inode_curr);
+int copyImageRange(v6fs_t* fs,int fde,off_t in_off,off_t out_off,long long len,uring_type* ring);
+int cpout(v6fs_t* fs,char* extFile,char* intFile);
+void bulkWait(v6fs_t* fs);
+int inodePinned(v6fs_t* fs,int iNumber);
+
+#endif
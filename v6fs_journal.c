@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "v6fs_internal.h"
+
+/*
+Metadata journal
+metadata blocks are only changed in the block cache. A commit appends every dirty cached block, the superblock
+included, to the journal region as one transaction, makes it durable with a single fdatasync and only then writes the
+blocks to their home locations. Commits happen between calls, every sync interval calls so the changes of many calls
+share one fdatasync, and earlier when the transaction couldn't take JOURNAL_CALL_BLOCKS more: a call is never split
+between two transactions, and dirty blocks stay in the cache, which grows past its size meanwhile, until they are
+committed. File data and newly allocated indirect blocks are written straight to their blocks before the transaction
+allocating them commits, so a file of any size adds only a few blocks to it. The same fdatasync makes the data
+durable, the indirect blocks are synced before the commit block is written.
+
+Committed transactions are replayed by openfs in sequence number order, a transaction whose commit block is missing
+or whose checksum doesn't match was torn by the crash and ends the replay. The region is emptied by a checkpoint once
+the home writes are durable: when it is full, when a block logged in it is about to be reused for file data (replay
+would overwrite the data with the logged metadata) and on close
+*/
+
+int journaling(v6fs_t* fs){
+    return fs->journal_blocks > 0 && fs->image_map == NULL;
+}
+
+unsigned int journalChecksum(unsigned int checksum,const void* data,size_t len){
+    const unsigned char* bytes = data;
+    size_t i;
+    for(i=0;i<len;i++)
+        checksum = (checksum ^ bytes[i]) * 16777619u;
+    return checksum;
+}
+
+int journalSync(v6fs_t* fs){
+    V6FS_STAT(fs,syncs,1);
+    return fdatasync(fs->fd) == -1 ? V6FS_EIO : V6FS_OK;
+}
+
+//the header lives in the boot block, which the file system doesn't use otherwise
+int journalWriteHeader(v6fs_t* fs){
+    char block[BLOCKSIZE];
+    memset(block,0,sizeof(block));
+    journal_header_type* header = (journal_header_type*)block;
+    header->magic = JOURNAL_MAGIC;
+    header->start = fs->journal_start;
+    header->num_blocks = fs->journal_blocks;
+    header->seq = fs->journal_base_seq;
+
+    V6FS_STAT(fs,writes,1);
+    V6FS_STAT(fs,write_bytes,BLOCKSIZE);
+    return pwrite(fs->fd,block,BLOCKSIZE,0) == BLOCKSIZE ? V6FS_OK : V6FS_EIO;
+}
+
+void journalAllocMap(v6fs_t* fs,int totalBlocks){
+    free(fs->journal_map);
+    fs->journal_map = calloc((totalBlocks+63)/64,sizeof(unsigned long long));
+}
+
+//setting up an empty journal in the last num_blocks blocks of a freshly formatted image
+void journalFormat(v6fs_t* fs,int num_blocks){
+    fs->journal_start = fs->superBlock.fsize - num_blocks;
+    fs->journal_blocks = num_blocks;
+    fs->journal_pos = 0;
+    fs->journal_seq = 1;
+    fs->journal_base_seq = 1;
+    journalAllocMap(fs,fs->superBlock.fsize);
+    journalWriteHeader(fs);
+    journalSync(fs);
+}
+
+/*
+journalReplay() - writes the blocks of every committed transaction in the region to their home locations
+description: afterwards the region is emptied, the next transaction gets the sequence number after the last one replayed
+*/
+int journalReplay(v6fs_t* fs){
+    int n = fs->journal_blocks;
+    char* region = malloc((size_t)n*BLOCKSIZE);
+    V6FS_STAT(fs,reads,1);
+    if(pread(fs->fd,region,(size_t)n*BLOCKSIZE,(off_t)BLOCKSIZE*fs->journal_start) != (ssize_t)n*BLOCKSIZE){
+        free(region);
+        return V6FS_EIO;
+    }
+    V6FS_STAT(fs,read_bytes,(size_t)n*BLOCKSIZE);
+
+    unsigned int seq = fs->journal_base_seq;
+    int pos = 0;
+    int status = V6FS_OK;
+    while(pos < n){
+        //checking the whole transaction before any of it is applied
+        int txn_start = pos;
+        unsigned int count = 0;
+        unsigned int checksum = 2166136261u;
+        int committed = 0;
+        while(pos < n){
+            journal_desc_type* desc = (journal_desc_type*)(region + (size_t)pos*BLOCKSIZE);
+            if(desc->magic == JOURNAL_COMMIT_MAGIC){
+                journal_commit_type* commit = (journal_commit_type*)desc;
+                committed = commit->seq == seq && commit->count == count && commit->checksum == checksum;
+                pos++;
+                break;
+            }
+            if(desc->magic != JOURNAL_DESC_MAGIC || desc->seq != seq || desc->count > JOURNAL_DESC_BLOCKS
+                || pos + 1 + (int)desc->count > n)
+                break;
+            checksum = journalChecksum(checksum,desc->blocks,sizeof(unsigned int)*desc->count);
+            checksum = journalChecksum(checksum,region + (size_t)(pos+1)*BLOCKSIZE,(size_t)desc->count*BLOCKSIZE);
+            count = count + desc->count;
+            pos = pos + 1 + desc->count;
+        }
+        if(committed == 0)
+            break;
+
+        int p = txn_start;
+        while(p < pos - 1){
+            journal_desc_type* desc = (journal_desc_type*)(region + (size_t)p*BLOCKSIZE);
+            unsigned int i;
+            for(i=0;i<desc->count;i++){
+                if(desc->blocks[i] == 0 || desc->blocks[i] >= (unsigned int)fs->journal_start)
+                    continue;
+                V6FS_STAT(fs,writes,1);
+                V6FS_STAT(fs,write_bytes,BLOCKSIZE);
+                if(pwrite(fs->fd,region + (size_t)(p+1+i)*BLOCKSIZE,BLOCKSIZE,(off_t)BLOCKSIZE*desc->blocks[i]) != BLOCKSIZE)
+                    status = V6FS_EIO;
+            }
+            p = p + 1 + desc->count;
+        }
+        seq++;
+    }
+    free(region);
+
+    if(seq != fs->journal_base_seq)
+        v6fsLog(fs,V6FS_LOG_INFO,"Journal replayed, %u transactions",seq - fs->journal_base_seq);
+
+    fs->journal_seq = seq;
+    fs->journal_base_seq = seq;
+    fs->journal_pos = 0;
+    if(journalSync(fs) < 0 || journalWriteHeader(fs) < 0 || journalSync(fs) < 0)
+        status = V6FS_EIO;
+    return status;
+}
+
+//reading the journal header of an image being opened and replaying the journal, before anything else is read
+int journalOpen(v6fs_t* fs){
+    fs->journal_blocks = 0;
+
+    journal_header_type header;
+    struct stat st;
+    if(fstat(fs->fd,&st) == -1 || pread(fs->fd,&header,sizeof(header),0) != sizeof(header))
+        return V6FS_OK;
+    int totalBlocks = st.st_size/BLOCKSIZE;
+    if(header.magic != JOURNAL_MAGIC || header.num_blocks < JOURNAL_MIN_BLOCKS
+        || header.start + header.num_blocks > (unsigned int)totalBlocks)
+        return V6FS_OK;
+
+    fs->journal_start = header.start;
+    fs->journal_blocks = header.num_blocks;
+    fs->journal_base_seq = header.seq;
+    journalAllocMap(fs,totalBlocks);
+    return journalReplay(fs);
+}
+
+int journalCompareEntries(const void* a,const void* b){
+    return (*(cache_entry_type**)a)->bNumber - (*(cache_entry_type**)b)->bNumber;
+}
+
+/*
+journalCheckpoint() - empties the journal region
+description: the home writes of the committed transactions are made durable first, then the header is moved past them
+*/
+int journalCheckpoint(v6fs_t* fs){
+    if(fs->journal_blocks == 0 || fs->journal_pos == 0)
+        return V6FS_OK;
+
+    int status = journalSync(fs);
+    fs->journal_base_seq = fs->journal_seq;
+    fs->journal_pos = 0;
+    if(status == V6FS_OK)
+        status = journalWriteHeader(fs);
+    if(status == V6FS_OK)
+        status = journalSync(fs);
+    memset(fs->journal_map,0,sizeof(unsigned long long) * ((fs->journal_start + fs->journal_blocks + 63)/64));
+    return status;
+}
+
+//writing count dirty blocks as the next transaction and then to their home locations
+int journalWriteTransaction(v6fs_t* fs,cache_entry_type** dirty,int count){
+    int num_desc = (count + JOURNAL_DESC_BLOCKS - 1)/JOURNAL_DESC_BLOCKS;
+    int size = count + num_desc + 1;
+    if(fs->journal_pos + size > fs->journal_blocks && journalCheckpoint(fs) < 0)
+        return V6FS_EIO;
+
+    char* txn = calloc(size,BLOCKSIZE);
+    unsigned int checksum = 2166136261u;
+    int pos = 0;
+    int i;
+    for(i=0;i<count;i=i+JOURNAL_DESC_BLOCKS){
+        journal_desc_type* desc = (journal_desc_type*)(txn + (size_t)pos*BLOCKSIZE);
+        desc->magic = JOURNAL_DESC_MAGIC;
+        desc->seq = fs->journal_seq;
+        desc->count = count - i < JOURNAL_DESC_BLOCKS ? count - i : JOURNAL_DESC_BLOCKS;
+        unsigned int k;
+        for(k=0;k<desc->count;k++){
+            desc->blocks[k] = dirty[i+k]->bNumber;
+            memcpy(txn + (size_t)(pos+1+k)*BLOCKSIZE,dirty[i+k]->data,BLOCKSIZE);
+        }
+        checksum = journalChecksum(checksum,desc->blocks,sizeof(unsigned int)*desc->count);
+        checksum = journalChecksum(checksum,txn + (size_t)(pos+1)*BLOCKSIZE,(size_t)desc->count*BLOCKSIZE);
+        pos = pos + 1 + desc->count;
+    }
+    journal_commit_type* commit = (journal_commit_type*)(txn + (size_t)pos*BLOCKSIZE);
+    commit->magic = JOURNAL_COMMIT_MAGIC;
+    commit->seq = fs->journal_seq;
+    commit->count = count;
+    commit->checksum = checksum;
+
+    V6FS_STAT(fs,writes,1);
+    V6FS_STAT(fs,write_bytes,(size_t)size*BLOCKSIZE);
+    ssize_t written = pwrite(fs->fd,txn,(size_t)size*BLOCKSIZE,(off_t)BLOCKSIZE*(fs->journal_start + fs->journal_pos));
+    free(txn);
+    if(written != (ssize_t)size*BLOCKSIZE || journalSync(fs) < 0)
+        return V6FS_EIO;
+
+    fs->journal_pos = fs->journal_pos + size;
+    fs->journal_seq++;
+    V6FS_STAT(fs,journal_commits,1);
+    V6FS_STAT(fs,journal_blocks,count);
+
+    //the transaction is durable, the blocks may go home now
+    for(i=0;i<count;i++){
+        fs->journal_map[dirty[i]->bNumber/64] |= 1ULL << (dirty[i]->bNumber%64);
+        cacheWriteBack(fs,dirty[i]);
+    }
+    return V6FS_OK;
+}
+
+//the largest transaction fitting in a region of num_blocks along with its descriptors and commit block
+int journalMaxCount(int num_blocks){
+    return num_blocks - 2 - num_blocks/JOURNAL_DESC_BLOCKS;
+}
+
+//smallest journal for an image of totalBlocks: two calls and a rewrite of the whole free chain fit in one transaction
+int journalMinBlocks(int totalBlocks){
+    int count = 2*JOURNAL_CALL_BLOCKS + totalBlocks/250 + 2;
+    return count + 3 + count/(JOURNAL_DESC_BLOCKS-1);
+}
+
+//blocks the transaction being grouped can still take, the superblock is counted as dirty
+int journalRoom(v6fs_t* fs){
+    return journalMaxCount(fs->journal_blocks) - fs->cache_dirty - 1;
+}
+
+/*
+journalReserve() - commits the transaction being grouped unless num_blocks more fit in it
+description: also commits when blocks freed by earlier calls wait for it, so the call about to allocate can have them.
+            Only called between changes that must stay together, before a call or a step of one changes anything
+*/
+void journalReserve(v6fs_t* fs,int num_blocks){
+    if(journaling(fs) == 0)
+        return;
+    icacheFlush(fs);
+    if(journalRoom(fs) < num_blocks || fs->frees_waiting)
+        journalCommit(fs);
+}
+
+/*
+journalCommit() - commits every dirty cached block and inode, the in-memory superblock included, as one transaction
+description: the blocks freed since the last commit are put on the free chain first and go out with it, as many as
+            the transaction has room for. Returns V6FS_ENOSPC, with nothing written, when the dirty blocks don't fit
+            the region, which the reservations of the callers keep from happening
+*/
+int journalCommit(v6fs_t* fs){
+    if(journaling(fs) == 0)
+        return V6FS_OK;
+
+    icacheFlush(fs);
+    releaseDeferred(fs);
+    fs->frees_waiting = fs->frees_waiting && fs->num_deferred > 0;
+    flushSuperBlock(fs);
+    if(fs->cache_hash == NULL)
+        return V6FS_OK;
+
+    cache_entry_type** dirty = malloc(sizeof(cache_entry_type*) * (fs->cache_count+1));
+    int num_dirty = 0;
+    cache_entry_type* entry;
+    for(entry = fs->lru_head;entry != NULL;entry = entry->lru_next){
+        if(entry->dirty)
+            dirty[num_dirty++] = entry;
+    }
+    qsort(dirty,num_dirty,sizeof(cache_entry_type*),journalCompareEntries);
+
+    int status = V6FS_OK;
+    if(num_dirty > journalMaxCount(fs->journal_blocks)){
+        v6fsLog(fs,V6FS_LOG_INFO,"Transaction of %d blocks doesn't fit the journal, not committed",num_dirty);
+        status = V6FS_ENOSPC;
+    }else if(num_dirty > 0 || fs->journal_unsynced){
+        //indirect blocks written straight to the image must be durable before a commit block points to them
+        if(fs->journal_unsynced)
+            status = journalSync(fs);
+        fs->journal_unsynced = 0;
+        if(status == V6FS_OK && num_dirty > 0)
+            status = journalWriteTransaction(fs,dirty,num_dirty);
+    }
+
+    free(dirty);
+    cacheTrim(fs);
+    return status;
+}
+
+//checking if replaying the journal could overwrite bNumber
+int journalHolds(v6fs_t* fs,int bNumber){
+    return fs->journal_map != NULL && fs->journal_pos > 0 && (fs->journal_map[bNumber/64] & (1ULL << (bNumber%64)));
+}
+
+void journalClose(v6fs_t* fs){
+    free(fs->journal_map);
+    fs->journal_map = NULL;
+    fs->journal_blocks = 0;
+}
@@ -0,0 +1,190 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "v6fs_internal.h"
+
+/*
+Freed blocks
+rm used to write a block of zeros over every block it freed, so removing a file cost as much I/O as writing it. A freed
+block is now only marked in punch_bitmap, and punchFlush() drops the contents of the marked blocks at the sync point,
+with one hole punched into the image per contiguous run (zeros are written where the image can't have holes). With a
+journal that happens after the commit freeing them, so a crash never leaves a file whose data was dropped. A marked
+block allocated again before the flush is unmarked by getFreeBlock(fs), the flush never touches live data.
+With V6FS_FREE_LAZY rm doesn't read the block map of the file at all: its addr[] is queued in fs->reclaim and
+reclaimRun() frees the queued files once their rm is committed, RECLAIM_BATCH blocks per sync point.
+On a journaled image a freed block isn't handed out again before the transaction freeing it is committed: replay
+after a crash would bring back the file owning it, which must still find its blocks as it left them. deferFree() holds
+the block and releaseDeferred() puts it on the free chain right before the commit, so it goes out with it. A list mode
+chain block is held the same way once its list is taken, the committed superblock may still lead to it
+*/
+
+//called by putFreeBlock(fs) for a block going back on the free chain
+void scrubBlock(v6fs_t* fs,int bNumber){
+    cacheDiscard(fs,bNumber); //a dirty cached copy isn't worth writing anymore
+    if(fs->free_mode == V6FS_FREE_KEEP)
+        return;
+
+    if(fs->punch_bitmap == NULL){
+        fs->punch_bitmap_words = (fs->superBlock.fsize+63)/64;
+        fs->punch_bitmap = calloc(fs->punch_bitmap_words,sizeof(unsigned long long));
+    }
+    if((fs->punch_bitmap[bNumber/64] & (1ULL << (bNumber%64))) == 0){
+        fs->punch_bitmap[bNumber/64] |= 1ULL << (bNumber%64);
+        fs->num_punch++;
+    }
+}
+
+//keeping a freed block that is used again from being scrubbed
+void punchCancel(v6fs_t* fs,int bNumber){
+    if(fs->num_punch > 0 && (fs->punch_bitmap[bNumber/64] & (1ULL << (bNumber%64)))){
+        fs->punch_bitmap[bNumber/64] &= ~(1ULL << (bNumber%64));
+        fs->num_punch--;
+    }
+}
+
+//dropping the contents of blocks start to start+num_blocks-1
+void scrubRun(v6fs_t* fs,int start,int num_blocks){
+    off_t offset = (off_t)BLOCKSIZE * start;
+    if(fs->free_mode == V6FS_FREE_PUNCH){
+        if(fallocate(fs->fd,FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,offset,(off_t)BLOCKSIZE * num_blocks) == 0){
+            V6FS_STAT(fs,blocks_punched,num_blocks);
+            return;
+        }
+        v6fsLog(fs,V6FS_LOG_INFO,"Punching holes into the image failed, freed blocks are overwritten with zeros");
+        fs->free_mode = V6FS_FREE_ZERO;
+    }
+
+    char* zeros = calloc(SCRUB_CHUNK,BLOCKSIZE);
+    while(num_blocks > 0){
+        int num = num_blocks < SCRUB_CHUNK ? num_blocks : SCRUB_CHUNK;
+        pwrite(fs->fd,zeros,(size_t)BLOCKSIZE * num,offset);
+        V6FS_STAT(fs,writes,1);
+        V6FS_STAT(fs,write_bytes,(long long)BLOCKSIZE * num);
+        offset += (off_t)BLOCKSIZE * num;
+        num_blocks -= num;
+    }
+    free(zeros);
+}
+
+//scrubbing the blocks freed since the last flush, a run of consecutive blocks at a time
+void punchFlush(v6fs_t* fs){
+    if(fs->num_punch == 0)
+        return;
+
+    int end_all = fs->punch_bitmap_words*64;
+    int bNumber = nextBit(fs->punch_bitmap,fs->punch_bitmap_words,0,1);
+    while(bNumber < end_all){
+        int end = nextBit(fs->punch_bitmap,fs->punch_bitmap_words,bNumber,0);
+        scrubRun(fs,bNumber,end - bNumber);
+        bNumber = nextBit(fs->punch_bitmap,fs->punch_bitmap_words,end,1);
+    }
+
+    memset(fs->punch_bitmap,0,sizeof(unsigned long long) * fs->punch_bitmap_words);
+    fs->num_punch = 0;
+}
+
+//holding a block freed on a journaled image until the next commit
+void deferFree(v6fs_t* fs,int bNumber){
+    if(fs->num_deferred == fs->deferred_capacity){
+        fs->deferred_capacity = fs->deferred_capacity > 0 ? fs->deferred_capacity*2 : 256;
+        fs->deferred = realloc(fs->deferred,sizeof(int) * fs->deferred_capacity);
+    }
+    fs->deferred[fs->num_deferred++] = bNumber;
+}
+
+//putting the held blocks on the free chain, nothing may be allocated between this and the commit. In list mode every
+//251 of them fill a chain block of the transaction, as many go as it has room for and the rest wait for the next commit
+void releaseDeferred(v6fs_t* fs){
+    int num = fs->num_deferred;
+    if(journaling(fs) && fs->extent_alloc == 0){
+        long long room = journalRoom(fs);
+        if(room*251 < num)
+            num = room > 0 ? room*251 : 0;
+    }
+
+    int i;
+    for(i=fs->num_deferred - num;i<fs->num_deferred;i++)
+        putFreeBlock(fs,fs->deferred[i]);
+    fs->num_deferred -= num;
+}
+
+//taking the blocks of an inode being removed, its addr[] entries are set to 0 as by freeFileBlocks(fs)
+void reclaimQueue(v6fs_t* fs,inode_type* inode){
+    if(fs->num_reclaim == fs->reclaim_capacity){
+        fs->reclaim_capacity = fs->reclaim_capacity > 0 ? fs->reclaim_capacity*2 : 64;
+        fs->reclaim = realloc(fs->reclaim,sizeof(reclaim_type) * fs->reclaim_capacity);
+    }
+
+    reclaim_type* item = &fs->reclaim[fs->num_reclaim++];
+    memcpy(item->addr,inode->addr,sizeof(item->addr));
+    item->flags = inode->flags;
+    item->next = 0;
+    memset(inode->addr,0,sizeof(inode->addr));
+    inode->flags = inode->flags & ~LARGEFILE;
+
+    //without a journal the removal is as durable as anything else right away
+    if(journaling(fs) == 0)
+        fs->reclaim_ready = fs->num_reclaim;
+}
+
+//the files queued so far have been removed by a committed transaction
+void reclaimCommitted(v6fs_t* fs){
+    fs->reclaim_ready = fs->num_reclaim;
+}
+
+/*
+reclaimRun() - frees the blocks of the queued files whose rm is committed
+parameters: budget - blocks to free before returning, 0 for all of them
+description: files are freed an addr[] entry at a time, so a batch can stop in the middle of a file and go past budget
+            by the blocks under one entry. Returns the number of blocks freed
+*/
+int reclaimRun(v6fs_t* fs,int budget){
+    int freed = 0;
+    while(fs->reclaim_head < fs->reclaim_ready && (budget == 0 || freed < budget)){
+        reclaim_type* item = &fs->reclaim[fs->reclaim_head];
+        int i = item->next++;
+        freed += freeAddr(fs,item->addr[i],item->flags,i);
+        if(item->next == 9)
+            fs->reclaim_head++;
+    }
+
+    if(fs->reclaim_head > 0 && fs->reclaim_head == fs->reclaim_ready){
+        fs->num_reclaim -= fs->reclaim_head;
+        memmove(fs->reclaim,fs->reclaim + fs->reclaim_head,sizeof(reclaim_type) * fs->num_reclaim);
+        fs->reclaim_head = 0;
+        fs->reclaim_ready = 0;
+    }
+    return freed;
+}
+
+//freeing every queued file, the rm calls since the last commit are committed first
+void reclaimDrain(v6fs_t* fs){
+    if(fs->num_reclaim == 0)
+        return;
+    if(fs->reclaim_ready < fs->num_reclaim){
+        journalCommit(fs);
+        reclaimCommitted(fs);
+    }
+    reclaimRun(fs,0);
+}
+
+//forgetting the freed and queued blocks, for a new file system or a closed handle
+void reclaimDestroy(v6fs_t* fs){
+    free(fs->punch_bitmap);
+    free(fs->reclaim);
+    free(fs->deferred);
+    fs->punch_bitmap = NULL;
+    fs->deferred = NULL;
+    fs->num_deferred = 0;
+    fs->deferred_capacity = 0;
+    fs->frees_waiting = 0;
+    fs->punch_bitmap_words = 0;
+    fs->num_punch = 0;
+    fs->reclaim = NULL;
+    fs->reclaim_head = 0;
+    fs->reclaim_ready = 0;
+    fs->num_reclaim = 0;
+    fs->reclaim_capacity = 0;
+}
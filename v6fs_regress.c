@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "v6fs.h"
+
+/*
+v6fs_regress - checks of problems fixed in the library, each on a freshly formatted image
+usage: v6fs_regress [-d work dir]
+    -d  directory the images and the external files are created in, /tmp by default
+
+every check prints one line, check <name> ok or check <name> FAILED: <what>, and the exit status is 1 when one failed
+*/
+
+char work_dir[200];
+int failed;
+
+//image and external file names in the work directory
+void workPath(char* path,const char* name){
+    snprintf(path,256,"%s/v6fs_regress_%s",work_dir,name);
+}
+
+//writing size bytes of a repeating pattern to an external file, returns 0 on failure
+int makeExtFile(char* path,long long size){
+    int fd = open(path,O_CREAT | O_WRONLY | O_TRUNC,0644);
+    if(fd == -1)
+        return 0;
+    char buf[65536];
+    int i;
+    for(i=0;i<(int)sizeof(buf);i++)
+        buf[i] = 'a' + i%26;
+    while(size > 0){
+        int n = size < (long long)sizeof(buf) ? size : (long long)sizeof(buf);
+        if(write(fd,buf,n) != n)
+            break;
+        size = size - n;
+    }
+    close(fd);
+    return size == 0;
+}
+
+//returns 1 when both files hold the same bytes
+int sameFile(char* a,char* b){
+    FILE* fa = fopen(a,"rb");
+    FILE* fb = fopen(b,"rb");
+    int same = fa != NULL && fb != NULL;
+    while(same){
+        int ca = fgetc(fa);
+        int cb = fgetc(fb);
+        same = ca == cb;
+        if(ca == EOF)
+            break;
+    }
+    if(fa != NULL)
+        fclose(fa);
+    if(fb != NULL)
+        fclose(fb);
+    return same;
+}
+
+//recording the result of a step, returns 0 when it failed so the check can stop
+int expect(const char* name,int ok,const char* what){
+    if(!ok){
+        printf("check %s FAILED: %s\n",name,what);
+        failed = 1;
+    }
+    return ok;
+}
+
+//reporting a check whose steps all passed
+void passed(const char* name,int ok){
+    if(ok)
+        printf("check %s ok\n",name);
+    fflush(stdout);
+}
+
+//checking the image has no problems and closing it
+int closeClean(const char* name,v6fs_t* fs){
+    v6fs_fsck_t report;
+    int ok = expect(name,v6fs_fsck(fs,0,0,NULL,&report) == 0,"fsck found problems");
+    return expect(name,v6fs_close(fs) == V6FS_OK,"close") && ok;
+}
+
+/*
+checkFarDirectory() - directories whose blocks lie past 2 GB of an image
+description: in extent mode the allocations move forward through the image, so a 128 MB file copied in and removed
+            again 17 times leaves the next directory block past block 2^21, where a byte address no longer fits an int.
+            The directory is then grown until it is indexed. The punched holes keep the image small on disk
+*/
+void checkFarDirectory(){
+    const char* name = "far_directory";
+    char image[256];
+    char ext[256];
+    char out[256];
+    workPath(image,"far.img");
+    workPath(ext,"far_ext");
+    workPath(out,"far_out");
+    unlink(image);
+
+    int err;
+    v6fs_t* fs = v6fs_open(image,0,&err);
+    int ok = expect(name,fs != NULL,"open");
+    if(ok){
+        v6fs_set_alloc_mode(fs,V6FS_ALLOC_EXTENT);
+        v6fs_set_dir_index(fs,1);
+        ok = expect(name,v6fs_format(fs,2400000,100) == V6FS_OK,"format of 2400000 blocks");
+    }
+    ok = ok && expect(name,makeExtFile(ext,128LL*1024*1024),"external file");
+
+    int i;
+    for(i=0;i<17 && ok;i++){
+        ok = expect(name,v6fs_cpin(fs,ext,"/f") == V6FS_OK,"cpin /f");
+        ok = ok && expect(name,v6fs_rm(fs,"/f") == V6FS_OK,"rm /f");
+    }
+
+    ok = ok && expect(name,v6fs_mkdir(fs,"/z") == V6FS_OK,"mkdir /z");
+    ok = ok && expect(name,v6fs_mkdir(fs,"/z/y") == V6FS_OK,"mkdir /z/y");
+    ok = ok && expect(name,v6fs_mkdir(fs,"/z/y") == V6FS_EEXIST,"second mkdir /z/y");
+    ok = ok && expect(name,v6fs_lookup(fs,"/z/y") > 0,"lookup /z/y");
+    char path[64];
+    for(i=0;i<1000 && ok;i++){
+        snprintf(path,sizeof(path),"/z/d%d",i);
+        ok = expect(name,v6fs_mkdir(fs,path) == V6FS_OK,"mkdir in the indexed /z");
+    }
+    ok = ok && expect(name,v6fs_lookup(fs,"/z/d500") > 0 && v6fs_lookup(fs,"/z/y") > 0,"lookup in the indexed /z");
+    ok = ok && expect(name,v6fs_cpin(fs,ext,"/z/f") == V6FS_OK,"cpin /z/f");
+    ok = ok && expect(name,v6fs_cpout(fs,"/z/f",out) == V6FS_OK && sameFile(ext,out),"cpout /z/f");
+    ok = ok && expect(name,v6fs_rm(fs,"/z/f") == V6FS_OK,"rm /z/f");
+    if(fs != NULL)
+        ok = closeClean(name,fs) && ok;
+    passed(name,ok);
+
+    unlink(image);
+    unlink(ext);
+    unlink(out);
+}
+
+/*
+checkFailedCpin() - a cpin running out of blocks leaves no file behind
+description: a file larger than the image fails with V6FS_ENOSPC, once with each I/O backend. No name may point to
+            the part of it that was written, and its blocks and inode are free again for the next cpin
+*/
+void checkFailedCpin(){
+    const char* name = "failed_cpin";
+    char image[256];
+    char big[256];
+    char small[256];
+    char out[256];
+    workPath(image,"failed.img");
+    workPath(big,"failed_big");
+    workPath(small,"failed_small");
+    workPath(out,"failed_out");
+    int ok = expect(name,makeExtFile(big,5LL*1024*1024) && makeExtFile(small,300LL*1024),"external files");
+
+    int backend;
+    for(backend=V6FS_IO_SYNC;backend<=V6FS_IO_URING && ok;backend++){
+        unlink(image);
+        int err;
+        v6fs_t* fs = v6fs_open(image,0,&err);
+        ok = expect(name,fs != NULL,"open");
+        if(!ok)
+            break;
+        v6fs_set_io_backend(fs,backend);
+        ok = expect(name,v6fs_format(fs,600,10) == V6FS_OK,"format of 600 blocks");
+        ok = ok && expect(name,v6fs_cpin(fs,big,"/big") == V6FS_ENOSPC,"cpin of a file larger than the image");
+        ok = ok && expect(name,v6fs_lookup(fs,"/big") == V6FS_ENOENT,"lookup /big after the failed cpin");
+        ok = ok && expect(name,v6fs_cpin(fs,small,"/small") == V6FS_OK,"cpin /small after the failed cpin");
+        ok = ok && expect(name,v6fs_cpout(fs,"/small",out) == V6FS_OK && sameFile(small,out),"cpout /small");
+        ok = closeClean(name,fs) && ok;
+    }
+    passed(name,ok);
+
+    unlink(image);
+    unlink(big);
+    unlink(small);
+    unlink(out);
+}
+
+/*
+checkDuplicateCpin() - copying in over an existing name fails with V6FS_EEXIST
+description: the second cpin of a file and the second cpin -r of a tree must not add another entry of the same name,
+            so after one rm of each name the lookup finds nothing
+*/
+void checkDuplicateCpin(){
+    const char* name = "duplicate_cpin";
+    char image[256];
+    char ext[256];
+    char tree[256];
+    char path[300];
+    workPath(image,"dup.img");
+    workPath(ext,"dup_ext");
+    workPath(tree,"dup_tree");
+    unlink(image);
+    mkdir(tree,0755);
+
+    int i;
+    int ok = expect(name,makeExtFile(ext,20LL*1024),"external file");
+    for(i=0;i<3 && ok;i++){
+        snprintf(path,sizeof(path),"%s/t%d",tree,i);
+        ok = expect(name,makeExtFile(path,(i+1)*3000LL),"external tree");
+    }
+
+    int err;
+    v6fs_t* fs = v6fs_open(image,0,&err);
+    ok = ok && expect(name,fs != NULL,"open");
+    ok = ok && expect(name,v6fs_format(fs,2000,20) == V6FS_OK,"format of 2000 blocks");
+    ok = ok && expect(name,v6fs_cpin(fs,ext,"/x") == V6FS_OK,"cpin /x");
+    ok = ok && expect(name,v6fs_cpin(fs,ext,"/x") == V6FS_EEXIST,"second cpin /x");
+    ok = ok && expect(name,v6fs_cpin_tree(fs,tree,"/t",2) == V6FS_OK,"cpin -r /t");
+    ok = ok && expect(name,v6fs_cpin_tree(fs,tree,"/t",2) == V6FS_EEXIST,"second cpin -r /t");
+    ok = ok && expect(name,v6fs_rm(fs,"/x") == V6FS_OK && v6fs_lookup(fs,"/x") == V6FS_ENOENT,"one entry /x");
+    for(i=0;i<3 && ok;i++){
+        snprintf(path,sizeof(path),"/t/t%d",i);
+        ok = expect(name,v6fs_rm(fs,path) == V6FS_OK && v6fs_lookup(fs,path) == V6FS_ENOENT,"one entry in /t");
+    }
+    if(fs != NULL)
+        ok = closeClean(name,fs) && ok;
+    passed(name,ok);
+
+    unlink(image);
+    unlink(ext);
+    for(i=0;i<3;i++){
+        snprintf(path,sizeof(path),"%s/t%d",tree,i);
+        unlink(path);
+    }
+    rmdir(tree);
+}
+
+//renaming the directory entry from to to by rewriting its name in the image, returns 0 when it isn't found
+int renameEntry(char* image,const char* from,const char* to){
+    int fd = open(image,O_RDWR);
+    if(fd == -1)
+        return 0;
+    char want[28];
+    memset(want,0,sizeof(want));
+    memcpy(want,from,strlen(from));
+    char block[1024];
+    long long offset;
+    int found = 0;
+    for(offset=0;!found && pread(fd,block,sizeof(block),offset) == (int)sizeof(block);offset+=sizeof(block)){
+        int e;
+        for(e=0;e<1024/32 && !found;e++){
+            if(memcmp(block + e*32 + 4,want,sizeof(want)) != 0)
+                continue;
+            memset(want,0,sizeof(want));
+            memcpy(want,to,strlen(to));
+            found = pwrite(fd,want,sizeof(want),offset + e*32 + 4) == (int)sizeof(want);
+        }
+    }
+    close(fd);
+    return found;
+}
+
+/*
+checkDuplicateName() - fsck finds a name given twice in one directory
+description: the entry of /bb is renamed a in the image, the repair keeps the first /a and frees the file of the other
+*/
+void checkDuplicateName(){
+    const char* name = "duplicate_name";
+    char image[256];
+    char ext[256];
+    workPath(image,"dupname.img");
+    workPath(ext,"dupname_ext");
+    unlink(image);
+
+    int err;
+    int ok = expect(name,makeExtFile(ext,5000),"external file");
+    v6fs_t* fs = v6fs_open(image,0,&err);
+    ok = ok && expect(name,fs != NULL,"open");
+    ok = ok && expect(name,v6fs_format(fs,500,10) == V6FS_OK,"format of 500 blocks");
+    ok = ok && expect(name,v6fs_cpin(fs,ext,"/a") == V6FS_OK && v6fs_cpin(fs,ext,"/bb") == V6FS_OK,"cpin /a and /bb");
+    if(fs != NULL)
+        ok = expect(name,v6fs_close(fs) == V6FS_OK,"close") && ok;
+    fs = NULL;
+    ok = ok && expect(name,renameEntry(image,"bb","a"),"renaming the entry of /bb");
+
+    if(ok)
+        fs = v6fs_open(image,0,&err);
+    ok = ok && expect(name,fs != NULL,"reopen");
+    v6fs_fsck_t report;
+    ok = ok && expect(name,v6fs_fsck(fs,0,0,NULL,&report) > 0,"fsck of the duplicate name");
+    ok = ok && expect(name,v6fs_fsck(fs,V6FS_FSCK_REPAIR,0,NULL,&report) > 0,"fsck repair");
+    ok = ok && expect(name,v6fs_lookup(fs,"/a") > 0 && v6fs_rm(fs,"/a") == V6FS_OK,"rm /a");
+    ok = ok && expect(name,v6fs_lookup(fs,"/a") == V6FS_ENOENT,"one entry /a left by the repair");
+    if(fs != NULL)
+        ok = closeClean(name,fs) && ok;
+    passed(name,ok);
+
+    unlink(image);
+    unlink(ext);
+}
+
+int main(int argc,char* argv[]){
+    strcpy(work_dir,"/tmp");
+    int i;
+    for(i=1;i<argc;i++){
+        if(strcmp(argv[i],"-d") == 0 && i+1 < argc && strlen(argv[i+1]) < 150){
+            strcpy(work_dir,argv[++i]);
+        }else{
+            fprintf(stderr,"Usage: %s [-d work dir]\n",argv[0]);
+            return 1;
+        }
+    }
+
+    checkFarDirectory();
+    checkFailedCpin();
+    checkDuplicateCpin();
+    checkDuplicateName();
+    return failed;
+}
@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "v6fs.h"
+
+/*
+v6fs_replay - re-executes a trace recorded with v6FileSystem -t against a fresh image
+usage: v6fs_replay [-i image] [-x scratch dir] [-f] [-j threads] [-s stats file] trace
+    -i  image the trace is replayed on, recreated first. /tmp/v6fs_replay.img by default
+    -x  directory the external files are created in, /tmp by default
+    -f  runs the commands back to back instead of at their recorded start times
+    -j  replays the whole trace once per thread at the same time, each thread in its own directory /r<n>
+    -s  file the counters of the image are written to as JSON at the end, - for stdout
+
+the image is opened with the flags of the first openfs in the trace and formatted with the sizes of its first
+initfs, later openfs and initfs commands are skipped. cpin reads a file of the recorded size made up in the scratch
+directory instead of the original one, cpout writes into the scratch directory. cpin -r needs the original tree and
+is skipped when it no longer exists. Relative paths are resolved by the replay against the directory the thread cd'ed
+into, so threads don't share the current directory of the handle.
+
+a line per command type and a summary are printed:
+    replay <command> calls=<n> recorded_us=<n> replayed_us=<n>
+    replay total commands=<n> skipped=<n> mismatches=<n> recorded_us=<n> replayed_us=<n> wall_us=<n>
+mismatches counts commands whose success or failure differs from the recording
+*/
+
+#define REPLAY_DEFAULT_BLOCKS 100000
+#define REPLAY_DEFAULT_INODE_BLOCKS 1000
+#define REPLAY_MAX_CMDS 16
+#define REPLAY_SKIPPED 0x7fffffff //returned by replayCommand() for commands which are not replayed
+
+//one line of the trace
+typedef struct {
+    long long start;
+    long long dur;
+    int status;
+    long long size;
+    char line[256];
+} trace_record_type;
+
+typedef struct {
+    char name[16];
+    long long calls;
+    long long recorded_us;
+    long long replayed_us;
+} replay_cmd_type;
+
+typedef struct {
+    int id;
+    char prefix[16]; //directory the thread replays in, empty for a single thread
+    char cwd[256];
+    long long skipped;
+    long long mismatches;
+    replay_cmd_type cmds[REPLAY_MAX_CMDS];
+    int num_cmds;
+} replay_thread_type;
+
+v6fs_t* fs;
+trace_record_type* records;
+int num_records;
+char scratch_dir[200];
+int fast = 0;
+long long replay_start;
+
+long long clockUsecs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+int readTrace(char* fileName){
+    FILE* in = fopen(fileName,"r");
+    if(in == NULL)
+        return -1;
+
+    int capacity = 1024;
+    records = malloc(sizeof(trace_record_type) * capacity);
+    num_records = 0;
+
+    char buf[512];
+    while(fgets(buf,sizeof(buf),in) != NULL){
+        if(buf[0] == '#')
+            continue;
+        if(num_records == capacity){
+            capacity = capacity*2;
+            records = realloc(records,sizeof(trace_record_type) * capacity);
+        }
+
+        trace_record_type* rec = &records[num_records];
+        int used = 0;
+        if(sscanf(buf,"%lld %lld %d %lld %n",&rec->start,&rec->dur,&rec->status,&rec->size,&used) < 4 || used == 0)
+            continue;
+        snprintf(rec->line,sizeof(rec->line),"%s",buf + used);
+        rec->line[strcspn(rec->line,"\r\n")] = '\0';
+        num_records++;
+    }
+    fclose(in);
+    return num_records;
+}
+
+/*
+absolutePath() - the absolute path in the image of path as given to a command of thread t
+description: the path is joined to the directory of the thread, or to its prefix when it starts with /, and . and ..
+            components are removed. Returns -1 when the result doesn't fit in 256 bytes
+*/
+int absolutePath(replay_thread_type* t,char* path,char* out){
+    char joined[600];
+    snprintf(joined,sizeof(joined),"%s/%s",path[0] == '/' ? t->prefix : t->cwd,path);
+
+    char* parts[300];
+    int num_parts = 0;
+    char* part = strtok(joined,"/");
+    while(part != NULL){
+        if(strcmp(part,"..") == 0){
+            if(num_parts > 0)
+                num_parts--;
+        }else if(strcmp(part,".") != 0 && num_parts < 300){
+            parts[num_parts++] = part;
+        }
+        part = strtok(NULL,"/");
+    }
+
+    int len = 0;
+    int i;
+    out[0] = '\0';
+    for(i=0;i<num_parts;i++){
+        len = len + strlen(parts[i]) + 1;
+        if(len >= 256)
+            return -1;
+        strcat(out,"/");
+        strcat(out,parts[i]);
+    }
+    if(num_parts == 0)
+        strcpy(out,"/");
+    return 0;
+}
+
+//the made up external file of size bytes read by cpin, created once for each size
+void inputFile(long long size,char* out){
+    snprintf(out,256,"%s/v6fs_replay_in_%lld",scratch_dir,size);
+
+    struct stat st;
+    if(stat(out,&st) == 0 && st.st_size == size)
+        return;
+
+    //written under a temporary name so a thread never reads a half written file
+    char tmp[300];
+    snprintf(tmp,sizeof(tmp),"%s.%lx",out,(unsigned long)pthread_self());
+    int fd = open(tmp,O_CREAT | O_WRONLY | O_TRUNC,0644);
+    if(fd == -1)
+        return;
+    char buf[65536];
+    int i;
+    for(i=0;i<(int)sizeof(buf);i++)
+        buf[i] = 'a' + i%26;
+    long long left = size;
+    while(left > 0){
+        int n = left < (long long)sizeof(buf) ? left : (long long)sizeof(buf);
+        if(write(fd,buf,n) != n)
+            break;
+        left = left - n;
+    }
+    close(fd);
+    rename(tmp,out);
+}
+
+void addCommand(replay_thread_type* t,char* name,long long calls,long long recorded,long long replayed){
+    int i;
+    for(i=0;i<t->num_cmds && strcmp(t->cmds[i].name,name) != 0;i++);
+    if(i == t->num_cmds){
+        if(t->num_cmds == REPLAY_MAX_CMDS)
+            return;
+        memset(&t->cmds[i],0,sizeof(replay_cmd_type));
+        snprintf(t->cmds[i].name,sizeof(t->cmds[i].name),"%s",name);
+        t->num_cmds++;
+    }
+    t->cmds[i].calls = t->cmds[i].calls + calls;
+    t->cmds[i].recorded_us = t->cmds[i].recorded_us + recorded;
+    t->cmds[i].replayed_us = t->cmds[i].replayed_us + replayed;
+}
+
+/*
+replayCommand() - runs the command of rec for thread t
+description: returns the status of the call, or REPLAY_SKIPPED
+*/
+int replayCommand(replay_thread_type* t,trace_record_type* rec){
+    char line[256];
+    strcpy(line,rec->line);
+    char* token = strtok(line," \t");
+    char* first = strtok(NULL," \t");
+    char* second = strtok(NULL," \t");
+    char* third = strtok(NULL," \t");
+    char path[256];
+    char ext[256];
+
+    if(token == NULL)
+        return REPLAY_SKIPPED;
+
+    if(strcmp(token,"mkdir") == 0 && first != NULL){
+        if(absolutePath(t,first,path) < 0)
+            return V6FS_ENAMETOOLONG;
+        return v6fs_mkdir(fs,path);
+    }else if(strcmp(token,"cd") == 0 && first != NULL){
+        if(absolutePath(t,first,path) < 0)
+            return V6FS_ENAMETOOLONG;
+        int status = v6fs_lookup(fs,path);
+        if(status >= 0)
+            strcpy(t->cwd,path);
+        return status;
+    }else if(strcmp(token,"rm") == 0 && first != NULL){
+        if(absolutePath(t,first,path) < 0)
+            return V6FS_ENAMETOOLONG;
+        return v6fs_rm(fs,path);
+    }else if(strcmp(token,"cpin") == 0 && first != NULL && second != NULL){
+        if(strcmp(first,"-r") == 0){
+            struct stat st;
+            if(third == NULL || stat(second,&st) == -1)
+                return REPLAY_SKIPPED;
+            if(absolutePath(t,third,path) < 0)
+                return V6FS_ENAMETOOLONG;
+            return v6fs_cpin_tree(fs,second,path,0);
+        }
+        if(rec->size < 0)
+            return REPLAY_SKIPPED;
+        if(absolutePath(t,second,path) < 0)
+            return V6FS_ENAMETOOLONG;
+        inputFile(rec->size,ext);
+        return v6fs_cpin(fs,ext,path);
+    }else if(strcmp(token,"cpout") == 0 && first != NULL && second != NULL){
+        if(strcmp(first,"-r") == 0){
+            if(third == NULL)
+                return REPLAY_SKIPPED;
+            if(absolutePath(t,second,path) < 0)
+                return V6FS_ENAMETOOLONG;
+            snprintf(ext,sizeof(ext),"%s/v6fs_replay_tree_%d",scratch_dir,t->id);
+            return v6fs_cpout_tree(fs,path,ext,0);
+        }
+        if(absolutePath(t,first,path) < 0)
+            return V6FS_ENAMETOOLONG;
+        snprintf(ext,sizeof(ext),"%s/v6fs_replay_out_%d",scratch_dir,t->id);
+        return v6fs_cpout(fs,path,ext);
+    }else if(strcmp(token,"sync") == 0){
+        return v6fs_sync(fs);
+    }else if(strcmp(token,"cachesize") == 0 && first != NULL){
+        return v6fs_set_cache_size(fs,atoi(first));
+    }else if(strcmp(token,"allocmode") == 0){
+        return v6fs_set_alloc_mode(fs,first != NULL && strcmp(first,"extent") == 0 ? V6FS_ALLOC_EXTENT : V6FS_ALLOC_LIST);
+    }else if(strcmp(token,"dirindex") == 0){
+        return v6fs_set_dir_index(fs,first != NULL && strcmp(first,"on") == 0);
+    }else if(strcmp(token,"freemode") == 0){
+        int mode = first == NULL ? V6FS_FREE_PUNCH : strcmp(first,"zero") == 0 ? V6FS_FREE_ZERO :
+            strcmp(first,"keep") == 0 ? V6FS_FREE_KEEP : V6FS_FREE_PUNCH;
+        return v6fs_set_free_mode(fs,second != NULL && strcmp(second,"lazy") == 0 ? mode | V6FS_FREE_LAZY : mode);
+    }else if(strcmp(token,"iobackend") == 0){
+        v6fs_set_io_backend(fs,first != NULL && strcmp(first,"uring") == 0 ? V6FS_IO_URING : V6FS_IO_SYNC);
+        return V6FS_OK;
+    }else if(strcmp(token,"syncinterval") == 0 && first != NULL){
+        return v6fs_set_sync_interval(fs,atoi(first));
+    }
+
+    //openfs and initfs were handled before the replay, stats and invalid commands change nothing
+    return REPLAY_SKIPPED;
+}
+
+void* replayThread(void* arg){
+    replay_thread_type* t = arg;
+    strcpy(t->cwd,t->prefix[0] != '\0' ? t->prefix : "/");
+
+    int i;
+    for(i=0;i<num_records;i++){
+        trace_record_type* rec = &records[i];
+
+        if(fast == 0){
+            long long wait = replay_start + rec->start - clockUsecs();
+            if(wait > 0)
+                usleep(wait);
+        }
+
+        long long start = clockUsecs();
+        int status = replayCommand(t,rec);
+        long long dur = clockUsecs() - start;
+
+        if(status == REPLAY_SKIPPED){
+            t->skipped++;
+            continue;
+        }
+        if((status < 0) != (rec->status < 0))
+            t->mismatches++;
+
+        char name[16];
+        sscanf(rec->line,"%15s",name);
+        addCommand(t,name,1,rec->dur,dur);
+    }
+    return NULL;
+}
+
+int main(int argc,char* argv[]){
+    char image[256] = "/tmp/v6fs_replay.img";
+    char* stats_file = NULL;
+    char* trace_file = NULL;
+    int num_threads = 1;
+    strcpy(scratch_dir,"/tmp");
+
+    int i;
+    for(i=1;i<argc;i++){
+        if(strcmp(argv[i],"-i") == 0 && i+1 < argc && strlen(argv[i+1]) < 256){
+            strcpy(image,argv[++i]);
+        }else if(strcmp(argv[i],"-x") == 0 && i+1 < argc && strlen(argv[i+1]) < 150){
+            strcpy(scratch_dir,argv[++i]);
+        }else if(strcmp(argv[i],"-f") == 0){
+            fast = 1;
+        }else if(strcmp(argv[i],"-j") == 0 && i+1 < argc && atoi(argv[i+1]) > 0){
+            num_threads = atoi(argv[++i]);
+        }else if(strcmp(argv[i],"-s") == 0 && i+1 < argc){
+            stats_file = argv[++i];
+        }else if(argv[i][0] != '-' && trace_file == NULL){
+            trace_file = argv[i];
+        }else{
+            trace_file = NULL;
+            break;
+        }
+    }
+    if(trace_file == NULL){
+        fprintf(stderr,"Usage: %s [-i image] [-x scratch dir] [-f] [-j threads] [-s stats file] trace\n",argv[0]);
+        return 1;
+    }
+    if(readTrace(trace_file) < 0){
+        fprintf(stderr,"Cannot read %s\n",trace_file);
+        return 1;
+    }
+
+    //the image is set up as the first openfs and initfs of the trace left it
+    int flags = 0;
+    int total_blocks = REPLAY_DEFAULT_BLOCKS;
+    int inode_blocks = REPLAY_DEFAULT_INODE_BLOCKS;
+    int seen_openfs = 0;
+    int seen_initfs = 0;
+    for(i=0;i<num_records;i++){
+        char cmd[16] = "";
+        char first[256] = "";
+        char second[256] = "";
+        sscanf(records[i].line,"%15s %255s %255s",cmd,first,second);
+        if(strcmp(cmd,"openfs") == 0 && seen_openfs == 0){
+            flags = strcmp(second,"mmap") == 0 ? V6FS_MMAP : 0;
+            seen_openfs = 1;
+        }else if(strcmp(cmd,"initfs") == 0 && seen_initfs == 0 && records[i].status >= 0){
+            total_blocks = atoi(first);
+            inode_blocks = atoi(second);
+            seen_initfs = 1;
+        }
+    }
+    if(seen_initfs == 0)
+        fprintf(stderr,"No initfs in the trace, formatting with %d blocks and %d inode blocks\n",total_blocks,inode_blocks);
+
+    unlink(image);
+    int err;
+    fs = v6fs_open(image,flags,&err);
+    if(fs == NULL){
+        fprintf(stderr,"Cannot open %s: %s\n",image,v6fs_strerror(err));
+        return 1;
+    }
+    err = v6fs_format(fs,total_blocks,inode_blocks);
+    if(err < 0){
+        fprintf(stderr,"Cannot format %s: %s\n",image,v6fs_strerror(err));
+        return 1;
+    }
+
+    replay_thread_type* threads = calloc(num_threads,sizeof(replay_thread_type));
+    pthread_t* tids = malloc(sizeof(pthread_t) * num_threads);
+    for(i=0;i<num_threads;i++){
+        threads[i].id = i;
+        if(num_threads > 1){
+            snprintf(threads[i].prefix,sizeof(threads[i].prefix),"/r%d",i);
+            v6fs_mkdir(fs,threads[i].prefix);
+        }
+    }
+
+    replay_start = clockUsecs();
+    for(i=0;i<num_threads;i++)
+        pthread_create(&tids[i],NULL,replayThread,&threads[i]);
+    for(i=0;i<num_threads;i++)
+        pthread_join(tids[i],NULL);
+    long long wall = clockUsecs() - replay_start;
+
+    //merging the per thread totals into the first thread
+    replay_thread_type* total = &threads[0];
+    int j;
+    for(i=1;i<num_threads;i++){
+        total->skipped = total->skipped + threads[i].skipped;
+        total->mismatches = total->mismatches + threads[i].mismatches;
+        for(j=0;j<threads[i].num_cmds;j++){
+            replay_cmd_type* cmd = &threads[i].cmds[j];
+            addCommand(total,cmd->name,cmd->calls,cmd->recorded_us,cmd->replayed_us);
+        }
+    }
+
+    long long commands = 0;
+    long long recorded = 0;
+    long long replayed = 0;
+    for(j=0;j<total->num_cmds;j++){
+        replay_cmd_type* cmd = &total->cmds[j];
+        printf("replay %s calls=%lld recorded_us=%lld replayed_us=%lld\n",cmd->name,cmd->calls,cmd->recorded_us,cmd->replayed_us);
+        commands = commands + cmd->calls;
+        recorded = recorded + cmd->recorded_us;
+        replayed = replayed + cmd->replayed_us;
+    }
+    printf("replay total commands=%lld skipped=%lld mismatches=%lld recorded_us=%lld replayed_us=%lld wall_us=%lld\n",
+        commands,total->skipped,total->mismatches,recorded,replayed,wall);
+
+    if(stats_file != NULL){
+        FILE* out = strcmp(stats_file,"-") == 0 ? stdout : fopen(stats_file,"w");
+        if(out != NULL){
+            v6fs_write_stats_json(fs,out);
+            if(out != stdout)
+                fclose(out);
+        }
+    }
+
+    v6fs_close(fs);
+    free(threads);
+    free(tids);
+    free(records);
+    return 0;
+}
@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "v6fs_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define V6FS_HAVE_SIMD 1
+#endif
+
+/*
+Sparse files
+cpin leaves the blocks of the external file holding only zeros unallocated, addr or indirect entry 0, so disk images
+and other mostly empty payloads take the space and the writes of their data only. The holes of the external file are
+found with SEEK_DATA/SEEK_HOLE without reading them, and each block of the data in between is checked for zeros by
+the kernel zeroCheckSelect() picks. cpout already skips unallocated blocks, which stay holes in the external file
+*/
+
+int zeroCheckScalar(char* block){
+    unsigned long long* words = (unsigned long long*)block;
+    unsigned long long bits = 0;
+    int i;
+    for(i=0;i<BLOCKSIZE/8;i++)
+        bits |= words[i];
+    return bits == 0;
+}
+
+#ifdef V6FS_HAVE_SIMD
+
+__attribute__((target("sse2")))
+int zeroCheckSSE2(char* block){
+    __m128i bits = _mm_setzero_si128();
+    int i;
+    for(i=0;i<BLOCKSIZE;i=i+16)
+        bits = _mm_or_si128(bits,_mm_loadu_si128((__m128i*)(block + i)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bits,_mm_setzero_si128())) == 0xffff;
+}
+
+__attribute__((target("avx2")))
+int zeroCheckAVX2(char* block){
+    __m256i bits = _mm256_setzero_si256();
+    int i;
+    for(i=0;i<BLOCKSIZE;i=i+32)
+        bits = _mm256_or_si256(bits,_mm256_loadu_si256((__m256i*)(block + i)));
+    return _mm256_testz_si256(bits,bits);
+}
+
+#endif
+
+//the widest zero check the CPU supports, picked once per handle
+zero_check_type zeroCheckSelect(){
+#ifdef V6FS_HAVE_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return zeroCheckAVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return zeroCheckSSE2;
+#endif
+    return zeroCheckScalar;
+}
+
+/*
+nextData() - finds the next data of the external file fde at or after pos
+description: returns its start rounded down to a block, st_size when only a hole is left, and sets end to where it stops.
+            A file with every block allocated has no hole to look for, and where SEEK_DATA/SEEK_HOLE are not
+            supported the rest of the file is data
+*/
+long long nextData(v6fs_t* fs,int fde,struct stat* st,long long pos,long long* end){
+    *end = st->st_size;
+    if((long long)st->st_blocks*512 >= st->st_size)
+        return pos;
+
+    off_t data = lseek(fde,pos,SEEK_DATA);
+    V6FS_STAT(fs,seeks,1);
+    if(data == -1)
+        return errno == ENXIO ? st->st_size : pos;
+    off_t hole = lseek(fde,data,SEEK_HOLE);
+    V6FS_STAT(fs,seeks,1);
+    if(hole > data && hole < st->st_size)
+        *end = hole;
+
+    //holes start and end on file system blocks, which are made of whole blocks of ours
+    return data - data%BLOCKSIZE;
+}
+
+//reading want bytes at pos of fde into buf, padded with zeros to a whole block. Returns the number of bytes read
+size_t readData(v6fs_t* fs,int fde,char* buf,size_t want,long long pos){
+    size_t got = 0;
+    while(got < want){
+        ssize_t n = pread(fde,buf + got,want - got,pos + got);
+        V6FS_STAT(fs,reads,1);
+        if(n <= 0)
+            break;
+        got = got + n;
+    }
+    V6FS_STAT(fs,read_bytes,got);
+    memset(buf + got,0,BLOCKSIZE);
+    return got;
+}
+
+//setting bit i of map for every block i of the len bytes in buf which is not all zeros, returns the number of them
+int dataBlocks(v6fs_t* fs,char* buf,size_t len,unsigned long long* map){
+    int num_data = 0;
+    int i;
+    for(i=0;(size_t)i*BLOCKSIZE<len;i++){
+        char* block = buf + (size_t)i*BLOCKSIZE;
+        if(*(unsigned long long*)block == 0 && fs->zero_check(block))
+            continue;
+        map[i/64] |= 1ULL << (i%64);
+        num_data++;
+    }
+    return num_data;
+}
+
+/*
+fileDataMap() - finds the blocks of the external file fde which hold anything but zeros
+description: *map is set to a malloc'ed bitmap with bit lbn%64 of word lbn/64 set for each of them, which the caller
+            frees. Returns the number of blocks set, V6FS_EFBIG or V6FS_EIO
+*/
+int fileDataMap(v6fs_t* fs,int fde,struct stat* st,unsigned long long** map){
+    long long num_blocks = (st->st_size + BLOCKSIZE - 1)/BLOCKSIZE;
+    if(num_blocks > MAX_FILE_BLOCKS)
+        return V6FS_EFBIG;
+
+    *map = calloc((num_blocks+63)/64 + 1,sizeof(unsigned long long));
+    char* buf = malloc(STREAM_BUFSIZE + BLOCKSIZE);
+    unsigned long long piece[STREAM_BUFSIZE/BLOCKSIZE/64];
+    int num_data = 0;
+    long long pos = 0;
+
+    while(pos < st->st_size && num_data >= 0){
+        long long end;
+        pos = nextData(fs,fde,st,pos,&end);
+        while(pos < end){
+            size_t want = end - pos < STREAM_BUFSIZE ? end - pos : STREAM_BUFSIZE;
+            size_t got = readData(fs,fde,buf,want,pos);
+            if(got < want){
+                num_data = V6FS_EIO;
+                break;
+            }
+
+            //pieces start on a block, and the data before a hole ends on a file system block
+            memset(piece,0,sizeof(piece));
+            dataBlocks(fs,buf,got,piece);
+            int i;
+            for(i=0;(size_t)i*BLOCKSIZE<got;i++){
+                int lbn = pos/BLOCKSIZE + i;
+                if((piece[i/64] & (1ULL << (i%64))) && ((*map)[lbn/64] & (1ULL << (lbn%64))) == 0){
+                    (*map)[lbn/64] |= 1ULL << (lbn%64);
+                    num_data++;
+                }
+            }
+            pos = pos + got;
+        }
+    }
+    free(buf);
+
+    if(num_data < 0){
+        free(*map);
+        *map = NULL;
+        return num_data;
+    }
+    V6FS_STAT(fs,blocks_sparse,num_blocks - num_data);
+    return num_data;
+}
+
+/*
+streamIn() - copies the external file fde into the file iNumber created for it by newFileInode()
+parameters: buf - STREAM_BUFSIZE + BLOCKSIZE bytes
+description: the data is read once, STREAM_BUFSIZE bytes at a time. The blocks of each piece holding anything but
+            zeros are allocated by fileRuns() and written from buf, so holes and blocks of zeros cost neither space
+            nor writes
+*/
+int streamIn(v6fs_t* fs,int fde,struct stat* st,int iNumber,char* buf){
+    unsigned long long piece[STREAM_BUFSIZE/BLOCKSIZE/64];
+    long long num_blocks = (st->st_size + BLOCKSIZE - 1)/BLOCKSIZE;
+    long long num_data = 0;
+    long long pos = 0;
+
+    while(pos < st->st_size){
+        long long end;
+        pos = nextData(fs,fde,st,pos,&end);
+        while(pos < end){
+            size_t want = end - pos < STREAM_BUFSIZE ? end - pos : STREAM_BUFSIZE;
+            size_t got = readData(fs,fde,buf,want,pos);
+            if(got < want)
+                return V6FS_EIO;
+
+            memset(piece,0,sizeof(piece));
+            int lbn = pos/BLOCKSIZE;
+            if(dataBlocks(fs,buf,got,piece) > 0){
+                block_run_type* runs;
+                int num_runs = fileRuns(fs,iNumber,1,piece,lbn,lbn + (got + BLOCKSIZE - 1)/BLOCKSIZE,&runs);
+                if(num_runs < 0)
+                    return num_runs;
+
+                int i;
+                for(i=0;i<num_runs;i++){
+                    size_t len = (size_t)runs[i].len*BLOCKSIZE;
+                    num_data += runs[i].len;
+                    V6FS_STAT(fs,writes,1);
+                    if(pwrite(fs->fd,buf + (size_t)(runs[i].lbn - lbn)*BLOCKSIZE,len,(off_t)BLOCKSIZE*runs[i].bNumber) != (ssize_t)len){
+                        free(runs);
+                        return V6FS_EIO;
+                    }
+                    V6FS_STAT(fs,write_bytes,len);
+                }
+                free(runs);
+            }
+            pos = pos + got;
+        }
+    }
+
+    V6FS_STAT(fs,blocks_sparse,num_blocks - num_data);
+    return V6FS_OK;
+}
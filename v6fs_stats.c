@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "v6fs_internal.h"
+
+/*
+Performance counters
+every handle counts the system calls it makes, block and inode allocations and the work done resolving paths in
+fs->stats, and times each public call into a log2 latency histogram per operation. The counters are plain adds,
+atomic only so the bulk copy workers can update them without the handle lock
+*/
+
+long long statsClock(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+//adding a call of op which began at start to its latency histogram
+void statsRecord(v6fs_t* fs,int op,long long start){
+    long long usecs = statsClock() - start;
+    int bucket = usecs > 0 ? 64 - __builtin_clzll(usecs) : 0;
+    if(bucket >= V6FS_LATENCY_BUCKETS)
+        bucket = V6FS_LATENCY_BUCKETS - 1;
+
+    V6FS_STAT(fs,op_calls[op],1);
+    V6FS_STAT(fs,op_usecs[op],usecs);
+    V6FS_STAT(fs,op_latency[op][bucket],1);
+}
+
+int v6fs_get_stats(v6fs_t* fs,v6fs_stats_t* stats){
+    if(stats == NULL)
+        return V6FS_EINVAL;
+
+    //every field is a long long, each one is loaded atomically since workers may be adding to it
+    long long* src = (long long*)&fs->stats;
+    long long* dst = (long long*)stats;
+    size_t i;
+    for(i=0;i<sizeof(v6fs_stats_t)/sizeof(long long);i++)
+        dst[i] = __atomic_load_n(&src[i],__ATOMIC_RELAXED);
+    return V6FS_OK;
+}
+
+int v6fs_reset_stats(v6fs_t* fs){
+    long long* counters = (long long*)&fs->stats;
+    size_t i;
+    for(i=0;i<sizeof(v6fs_stats_t)/sizeof(long long);i++)
+        __atomic_store_n(&counters[i],0,__ATOMIC_RELAXED);
+    return V6FS_OK;
+}
+
+const char* v6fs_op_name(int op){
+    switch(op){
+        case V6FS_OP_FORMAT: return "format";
+        case V6FS_OP_MKDIR: return "mkdir";
+        case V6FS_OP_CPIN: return "cpin";
+        case V6FS_OP_CPOUT: return "cpout";
+        case V6FS_OP_CPIN_TREE: return "cpin_tree";
+        case V6FS_OP_CPOUT_TREE: return "cpout_tree";
+        case V6FS_OP_RM: return "rm";
+        case V6FS_OP_LOOKUP: return "lookup";
+        case V6FS_OP_CHDIR: return "chdir";
+        case V6FS_OP_SYNC: return "sync";
+        case V6FS_OP_FSCK: return "fsck";
+    }
+    return "unknown";
+}
+
+/*
+v6fs_write_stats_json() - writes the counters as one JSON object on a single line
+description: the histogram of each operation is written up to its last non empty bucket, bucket i holding the
+            calls which took less than 2^i microseconds. Operations never called are left out
+*/
+int v6fs_write_stats_json(v6fs_t* fs,FILE* out){
+    v6fs_stats_t stats;
+    v6fs_get_stats(fs,&stats);
+
+    fprintf(out,"{\"io\":{\"reads\":%lld,\"read_bytes\":%lld,\"writes\":%lld,\"write_bytes\":%lld,\"seeks\":%lld,"
+        "\"copies\":%lld,\"copy_bytes\":%lld,\"syncs\":%lld},",
+        stats.reads,stats.read_bytes,stats.writes,stats.write_bytes,stats.seeks,
+        stats.copies,stats.copy_bytes,stats.syncs);
+    fprintf(out,"\"cache\":{\"hits\":%lld,\"misses\":%lld,\"inode_hits\":%lld,\"inode_misses\":%lld},",
+        stats.cache_hits,stats.cache_misses,stats.inode_cache_hits,stats.inode_cache_misses);
+    fprintf(out,"\"alloc\":{\"blocks_allocated\":%lld,\"blocks_freed\":%lld,\"blocks_punched\":%lld,"
+        "\"blocks_sparse\":%lld,\"inodes_allocated\":%lld,\"inodes_freed\":%lld,\"inodes_scanned\":%lld},",
+        stats.blocks_allocated,stats.blocks_freed,stats.blocks_punched,stats.blocks_sparse,stats.inodes_allocated,
+        stats.inodes_freed,stats.inodes_scanned);
+    fprintf(out,"\"lookup\":{\"dentry_hits\":%lld,\"dentries_compared\":%lld},",stats.dentry_hits,stats.dentries_compared);
+    fprintf(out,"\"journal\":{\"commits\":%lld,\"blocks\":%lld},",stats.journal_commits,stats.journal_blocks);
+
+    fprintf(out,"\"ops\":{");
+    int op;
+    int first = 1;
+    for(op=0;op<V6FS_NUM_OPS;op++){
+        if(stats.op_calls[op] == 0)
+            continue;
+
+        int last = V6FS_LATENCY_BUCKETS - 1;
+        while(last > 0 && stats.op_latency[op][last] == 0)
+            last--;
+
+        fprintf(out,"%s\"%s\":{\"calls\":%lld,\"usecs\":%lld,\"latency_log2_us\":[",first ? "" : ",",
+            v6fs_op_name(op),stats.op_calls[op],stats.op_usecs[op]);
+        int i;
+        for(i=0;i<=last;i++)
+            fprintf(out,"%s%lld",i == 0 ? "" : ",",stats.op_latency[op][i]);
+        fprintf(out,"]}");
+        first = 0;
+    }
+    fprintf(out,"}}\n");
+    return ferror(out) ? V6FS_EIO : V6FS_OK;
+}
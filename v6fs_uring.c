@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "v6fs_internal.h"
+
+/*
+io_uring backend for data block transfers
+copies are queued as linked read/write pairs through a small ring of in-flight buffers, so many block runs are
+in flight at once and submitted with one system call. The ring is driven with the raw system calls since liburing
+is not required. Where io_uring is missing at build or run time uringCreate() returns NULL and callers use their
+synchronous path
+*/
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define V6FS_HAVE_URING 1
+#endif
+#endif
+
+#ifdef V6FS_HAVE_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+//in-flight buffers, each holding one chunk of a copy between its read and its write
+#define URING_DEPTH 16
+#define URING_BUFSIZE (128*1024)
+
+struct uring {
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* ring_map;
+    size_t ring_map_size;
+    size_t sqes_size;
+    int to_submit; //sqes queued since the last io_uring_enter
+
+    char* bufs;
+    int free_slots[URING_DEPTH];
+    int num_free;
+    int pending[URING_DEPTH]; //completions still expected for each buffer
+    size_t want[URING_DEPTH*2]; //expected result of the read (even) and the write (odd) of each buffer
+};
+
+//checking the kernel supports the opcodes used here, which came after io_uring itself. Kernels older than them
+//don't have the probe either
+int uringProbe(int fd){
+    struct io_uring_probe* probe = calloc(1,sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op));
+    int supported = syscall(__NR_io_uring_register,fd,IORING_REGISTER_PROBE,probe,256) == 0
+        && probe->ops_len > IORING_OP_WRITE
+        && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+        && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+uring_type* uringCreate(){
+    struct io_uring_params params;
+    memset(&params,0,sizeof(params));
+    int fd = syscall(__NR_io_uring_setup,URING_DEPTH*2,&params);
+    if(fd < 0)
+        return NULL;
+
+    //kernels without a single mapping for both rings or without IORING_OP_READ/WRITE are left to the synchronous path
+    if((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || uringProbe(fd) == 0){
+        close(fd);
+        return NULL;
+    }
+
+    uring_type* ring = calloc(1,sizeof(uring_type));
+    ring->fd = fd;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    ring->ring_map_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_map = mmap(NULL,ring->ring_map_size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries*sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL,ring->sqes_size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,IORING_OFF_SQES);
+    if(ring->ring_map == MAP_FAILED || ring->sqes == MAP_FAILED
+        || posix_memalign((void**)&ring->bufs,4096,(size_t)URING_DEPTH*URING_BUFSIZE) != 0){
+        if(ring->ring_map != MAP_FAILED)
+            munmap(ring->ring_map,ring->ring_map_size);
+        if(ring->sqes != MAP_FAILED)
+            munmap(ring->sqes,ring->sqes_size);
+        close(fd);
+        free(ring);
+        return NULL;
+    }
+
+    char* map = ring->ring_map;
+    ring->sq_head = (unsigned*)(map + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(map + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(map + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(map + params.sq_off.array);
+    ring->cq_head = (unsigned*)(map + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(map + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(map + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(map + params.cq_off.cqes);
+
+    int i;
+    for(i=0;i<URING_DEPTH;i++)
+        ring->free_slots[i] = i;
+    ring->num_free = URING_DEPTH;
+    return ring;
+}
+
+void uringDestroy(uring_type* ring){
+    if(ring == NULL)
+        return;
+    munmap(ring->sqes,ring->sqes_size);
+    munmap(ring->ring_map,ring->ring_map_size);
+    close(ring->fd);
+    free(ring->bufs);
+    free(ring);
+}
+
+void uringQueue(uring_type* ring,int op,int fd,char* buf,size_t len,off_t off,int flags,unsigned long long user_data){
+    unsigned tail = *ring->sq_tail;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+    memset(sqe,0,sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(size_t)buf;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->flags = flags;
+    sqe->user_data = user_data;
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail,tail + 1,__ATOMIC_RELEASE);
+    ring->to_submit++;
+}
+
+//submitting the queued sqes and waiting for at least wait_nr completions
+int uringEnter(uring_type* ring,int wait_nr){
+    while(1){
+        int n = syscall(__NR_io_uring_enter,ring->fd,ring->to_submit,wait_nr,wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0,NULL,0);
+        if(n >= 0){
+            ring->to_submit = ring->to_submit - n;
+            return V6FS_OK;
+        }
+        if(errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return V6FS_EIO;
+    }
+}
+
+//handling every completion available, a buffer is free again once both its read and its write completed
+int uringReap(uring_type* ring){
+    int status = V6FS_OK;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE);
+
+    while(head != tail){
+        struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        int op = cqe->user_data;
+        if(cqe->res < 0 || (size_t)cqe->res != ring->want[op])
+            status = V6FS_EIO; //a short read cancels the linked write
+        if(--ring->pending[op/2] == 0)
+            ring->free_slots[ring->num_free++] = op/2;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+    return status;
+}
+
+//dropping the sqes the kernel has not taken yet, the buffers waiting only for them are free again
+void uringDiscard(uring_type* ring){
+    unsigned head = __atomic_load_n(ring->sq_head,__ATOMIC_ACQUIRE);
+    unsigned tail = *ring->sq_tail;
+
+    while(head != tail){
+        int op = ring->sqes[ring->sq_array[head & *ring->sq_mask]].user_data;
+        if(--ring->pending[op/2] == 0)
+            ring->free_slots[ring->num_free++] = op/2;
+        head++;
+    }
+    __atomic_store_n(ring->sq_tail,head,__ATOMIC_RELEASE);
+    ring->to_submit = 0;
+}
+
+/*
+uringCopy() - copies every segment from its input file to its output file through the ring
+description: each segment is cut into chunks of at most URING_BUFSIZE. A chunk is a read of in_len bytes linked to a
+            write of out_len bytes from the same buffer, the bytes past in_len are written as zeros. Chunks are submitted
+            in batches as buffers free up. Returns V6FS_OK or V6FS_EIO once every chunk submitted completed, no chunk
+            is submitted after an error
+*/
+int uringCopy(uring_type* ring,copy_segment_type* segs,int num_segs){
+    int status = V6FS_OK;
+    int i;
+
+    for(i=0;i<num_segs && status == V6FS_OK;i++){
+        long long done = 0;
+        while(done < segs[i].out_len){
+            while(ring->num_free == 0 && status == V6FS_OK){
+                if(uringEnter(ring,1) < 0 || uringReap(ring) < 0)
+                    status = V6FS_EIO;
+            }
+            if(status < 0)
+                break;
+
+            int slot = ring->free_slots[--ring->num_free];
+            char* buf = ring->bufs + (size_t)slot*URING_BUFSIZE;
+            size_t out_len = segs[i].out_len - done < URING_BUFSIZE ? segs[i].out_len - done : URING_BUFSIZE;
+            size_t in_len = 0;
+            if(done < segs[i].in_len)
+                in_len = segs[i].in_len - done < (long long)out_len ? segs[i].in_len - done : (long long)out_len;
+            memset(buf + in_len,0,out_len - in_len);
+
+            ring->pending[slot] = 1;
+            ring->want[slot*2 + 1] = out_len;
+            if(in_len > 0){
+                ring->pending[slot] = 2;
+                ring->want[slot*2] = in_len;
+                uringQueue(ring,IORING_OP_READ,segs[i].in_fd,buf,in_len,segs[i].in_off + done,IOSQE_IO_LINK,slot*2);
+            }
+            uringQueue(ring,IORING_OP_WRITE,segs[i].out_fd,buf,out_len,segs[i].out_off + done,0,slot*2 + 1);
+            done = done + out_len;
+
+            //submitting once the ring is full keeps the batches large
+            if(ring->num_free == 0 && uringEnter(ring,0) < 0)
+                status = V6FS_EIO;
+        }
+    }
+
+    //after an error the chunks not submitted yet are dropped, and everything in flight is waited for so the next call
+    //starts on an empty ring. Completions that can't be waited for now are reaped by the next call
+    while(ring->num_free < URING_DEPTH){
+        if(status < 0)
+            uringDiscard(ring);
+        if(ring->num_free == URING_DEPTH)
+            break;
+        if(uringEnter(ring,1) < 0){
+            if(status < 0)
+                break;
+            status = V6FS_EIO;
+            continue;
+        }
+        if(uringReap(ring) < 0)
+            status = V6FS_EIO;
+    }
+    return status;
+}
+
+#else
+
+uring_type* uringCreate(){
+    return NULL;
+}
+
+void uringDestroy(uring_type* ring){
+}
+
+int uringCopy(uring_type* ring,copy_segment_type* segs,int num_segs){
+    return V6FS_EIO;
+}
+
+#endif